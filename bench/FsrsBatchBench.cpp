@@ -0,0 +1,148 @@
+// Checks FsrsScheduler::scheduleBatch() against schedule() card by card, then
+// times both in cards per second.
+//
+//   FsrsBatchBench [cards] [rounds]
+//
+// Exits with 1 if any lane disagrees beyond the documented tolerance.
+#include "core/FsrsScheduler.h"
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+namespace {
+
+// Relative tolerance on stability and difficulty. The batch kernel's pow is
+// within a few ulp of libm; anything near this bound is a real bug.
+const double kTolerance = 1e-12;
+
+QList<FsrsCard> makeCards(int count, const QDateTime& now, std::mt19937_64& rng) {
+    std::uniform_real_distribution<double> logStability(std::log(0.1), std::log(3650.0));
+    std::uniform_real_distribution<double> difficulty(1.0, 10.0);
+    std::uniform_int_distribution<int> days(0, 400);
+    std::discrete_distribution<int> state({10, 5, 80, 5});
+
+    QList<FsrsCard> cards;
+    cards.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        FsrsCard card;
+        card.wordId = i;
+        card.state = state(rng);
+        if (card.state != 0) {
+            card.stability = std::exp(logStability(rng));
+            card.difficulty = difficulty(rng);
+            card.elapsedDays = days(rng);
+            card.scheduledDays = days(rng);
+            card.reps = 1 + days(rng) % 20;
+            card.lapses = days(rng) % 4;
+            card.lastReview = now.addDays(-card.elapsedDays);
+            card.due = card.lastReview.addDays(card.scheduledDays);
+        }
+        cards.append(card);
+    }
+    return cards;
+}
+
+bool nearlyEqual(double a, double b) {
+    return std::abs(a - b) <= kTolerance * std::max(std::abs(a), std::abs(b));
+}
+
+// Returns the number of lanes that disagree with schedule().
+int validate(FsrsScheduler& scheduler, const QList<FsrsCard>& cards, const QList<int>& ratings,
+             const QDateTime& now) {
+    FsrsCardBatch batch = FsrsCardBatch::fromCards(cards);
+    scheduler.scheduleBatch(batch, ratings);
+    QList<FsrsCard> batched = cards;
+    batch.applyTo(batched, now);
+
+    int mismatches = 0;
+    int roundings = 0;
+    double worst = 0.0;
+    for (qsizetype i = 0; i < cards.size(); ++i) {
+        const int rating = ratings[i];
+        const bool valid = rating >= FsrsRating::Again && rating <= FsrsRating::Easy;
+        FsrsCard expected = valid ? scheduler.schedule(cards[i], static_cast<FsrsRating::Rating>(rating), now)
+                                  : cards[i];
+        const FsrsCard& got = batched[i];
+        if (!valid) expected.lastReview = now; // applyTo() stamps every lane
+
+        if (expected.stability != 0.0) {
+            worst = std::max(worst, std::abs(got.stability - expected.stability) / expected.stability);
+        }
+        bool same = got.state == expected.state && got.reps == expected.reps
+                    && got.lapses == expected.lapses
+                    && nearlyEqual(got.stability, expected.stability)
+                    && nearlyEqual(got.difficulty, expected.difficulty);
+        if (same && got.scheduledDays != expected.scheduledDays) {
+            // An interval that rounds at exactly .5 may land a day apart.
+            same = std::abs(got.scheduledDays - expected.scheduledDays) == 1;
+            roundings += same;
+        } else if (same) {
+            same = got.due == expected.due;
+        }
+        if (!same) {
+            if (mismatches < 10) {
+                std::printf("mismatch lane %lld state %d rating %d: stability %.17g vs %.17g, days %d vs %d\n",
+                            static_cast<long long>(i), cards[i].state, rating, got.stability,
+                            expected.stability, got.scheduledDays, expected.scheduledDays);
+            }
+            ++mismatches;
+        }
+    }
+    std::printf("validated %lld lanes: %d mismatches, %d intervals a day apart at .5, "
+                "worst stability error %.3g\n", static_cast<long long>(cards.size()), mismatches,
+                roundings, worst);
+    return mismatches;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    const int count = argc > 1 ? std::max(1, std::atoi(argv[1])) : 1000000;
+    const int rounds = argc > 2 ? std::max(1, std::atoi(argv[2])) : 10;
+
+    // Fixed weights and no load balancing, whatever the local profile holds.
+    FsrsScheduler scheduler;
+    scheduler.setWeights(FsrsScheduler::defaultWeights());
+    scheduler.setDesiredRetention(0.9);
+    scheduler.setLoadBalancing(false);
+
+    std::mt19937_64 rng(20240601);
+    const QDateTime now = QDateTime::currentDateTime();
+    const QList<FsrsCard> cards = makeCards(count, now, rng);
+    QList<int> ratings(count);
+    std::uniform_int_distribution<int> rating(FsrsRating::Again, FsrsRating::Easy);
+    for (int& r : ratings) r = rating(rng);
+    // A few out-of-range ratings, which must leave their lanes untouched.
+    for (int i = 0; i < count; i += 997) ratings[i] = i % 2 ? 0 : 5;
+
+    if (validate(scheduler, cards, ratings, now) != 0) return 1;
+
+    // Rounds reschedule the same lanes again; the first one also pays for
+    // detaching the lists, so it is left out.
+    FsrsCardBatch batch = FsrsCardBatch::fromCards(cards);
+    scheduler.scheduleBatch(batch, ratings);
+    QElapsedTimer timer;
+    timer.start();
+    for (int round = 0; round < rounds; ++round) {
+        scheduler.scheduleBatch(batch, ratings);
+    }
+    const double batchSecs = timer.nsecsElapsed() / 1e9;
+
+    const int scalarCount = std::min(count, 200000);
+    timer.restart();
+    for (int i = 0; i < scalarCount; ++i) {
+        const int r = ratings[i];
+        if (r < FsrsRating::Again || r > FsrsRating::Easy) continue;
+        scheduler.schedule(cards[i], static_cast<FsrsRating::Rating>(r), now);
+    }
+    const double scalarSecs = timer.nsecsElapsed() / 1e9;
+
+    const double batchRate = double(count) * rounds / std::max(1e-9, batchSecs);
+    const double scalarRate = scalarCount / std::max(1e-9, scalarSecs);
+    std::printf("scheduleBatch: %.1f M cards/s (%d cards x %d rounds)\n", batchRate / 1e6, count, rounds);
+    std::printf("schedule():    %.1f M cards/s (%d cards)\n", scalarRate / 1e6, scalarCount);
+    return 0;
+}
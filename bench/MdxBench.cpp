@@ -0,0 +1,312 @@
+// Writes a synthetic MDict file and times MdxParser::parse() on it in entries
+// and decompressed megabytes per second.
+//
+//   MdxBench [entries] [zlib|lzo|none] [rounds]
+//
+// Exits with 1 if the parser fails or returns a different number of entries.
+#include "core/MdxParser.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QtEndian>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+enum class Codec { None = 0, Lzo = 1, Zlib = 2 };
+
+const qsizetype kRecordBlockSize = 64 * 1024;
+const int kKeysPerBlock = 2048;
+
+quint32 adler32(const QByteArray& data) {
+    quint32 a = 1, b = 0;
+    for (char c : data) {
+        a = (a + uchar(c)) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+void appendNumber(QByteArray& out, quint64 value) {
+    uchar bytes[8];
+    qToBigEndian(value, bytes);
+    out.append(reinterpret_cast<const char*>(bytes), 8);
+}
+
+void appendRunLength(QByteArray& out, qsizetype value) {
+    while (value > 255) {
+        out.append('\0');
+        value -= 255;
+    }
+    out.append(char(value));
+}
+
+// A greedy LZO1X encoder: enough to produce realistic type 1 blocks, not to
+// compress well.
+QByteArray lzoCompress(const QByteArray& data) {
+    const uchar *in = reinterpret_cast<const uchar*>(data.constData());
+    const qsizetype n = data.size();
+    std::vector<qsizetype> table(1 << 14, -1);
+    QByteArray out;
+    qsizetype literalStart = 0;
+    qsizetype stateByte = -1;
+
+    auto flushLiterals = [&](qsizetype end) {
+        qsizetype count = end - literalStart;
+        if (count == 0) return;
+        if (out.isEmpty() && count <= 238) {
+            out.append(char(17 + count));
+        } else if (count <= 3 && stateByte >= 0) {
+            out[stateByte] = char(out[stateByte] | count);
+        } else if (count <= 18) {
+            out.append(char(count - 3));
+        } else {
+            out.append('\0');
+            appendRunLength(out, count - 18);
+        }
+        out.append(data.constData() + literalStart, count);
+    };
+
+    qsizetype i = 0;
+    while (i + 3 <= n) {
+        const quint32 key = (quint32(in[i]) | quint32(in[i + 1]) << 8 | quint32(in[i + 2]) << 16) * 2654435761u >> 18;
+        const qsizetype candidate = table[key];
+        table[key] = i;
+        const qsizetype distance = i - candidate;
+        if (candidate < 0 || distance > 49151 || std::memcmp(in + candidate, in + i, 3) != 0) {
+            ++i;
+            continue;
+        }
+        qsizetype length = 3;
+        while (i + length < n && in[candidate + length] == in[i + length]) ++length;
+
+        flushLiterals(i);
+        if (length <= 8 && distance <= 2048) {
+            out.append(char(((length - 1) << 5) | (((distance - 1) & 7) << 2)));
+            out.append(char((distance - 1) >> 3));
+            stateByte = out.size() - 2;
+        } else {
+            quint32 word;
+            if (distance <= 16384) {
+                if (length - 2 <= 31) {
+                    out.append(char(32 | (length - 2)));
+                } else {
+                    out.append(char(32));
+                    appendRunLength(out, length - 2 - 31);
+                }
+                word = quint32(distance - 1) << 2;
+            } else {
+                const qsizetype far = distance - 16384;
+                const char high = char((far >> 14) << 3);
+                if (length - 2 <= 7) {
+                    out.append(char(16 | high | (length - 2)));
+                } else {
+                    out.append(char(16 | high));
+                    appendRunLength(out, length - 2 - 7);
+                }
+                word = quint32(far & 0x3fff) << 2;
+            }
+            out.append(char(word & 0xff));
+            out.append(char(word >> 8));
+            stateByte = out.size() - 2;
+        }
+        i += length;
+        literalStart = i;
+    }
+    flushLiterals(n);
+    out.append("\x11\x00\x00", 3);
+    return out;
+}
+
+QByteArray packBlock(const QByteArray& data, Codec codec) {
+    QByteArray out;
+    uchar head[8];
+    qToLittleEndian<quint32>(quint32(codec), head);
+    qToBigEndian<quint32>(adler32(data), head + 4);
+    out.append(reinterpret_cast<const char*>(head), 8);
+    switch (codec) {
+    case Codec::None: out.append(data); break;
+    case Codec::Lzo: out.append(lzoCompress(data)); break;
+    case Codec::Zlib: out.append(qCompress(data).mid(4)); break;
+    }
+    return out;
+}
+
+QByteArray makeRecord(const QByteArray& headword, std::mt19937& rng) {
+    static const char *const parts[] = {"n.", "v.", "adj.", "adv."};
+    static const char *const words[] = {
+        "the", "of", "a", "to", "state", "quality", "act", "process", "person", "thing",
+        "which", "being", "used", "in", "form", "that", "relating", "having", "made", "small"
+    };
+    std::uniform_int_distribution<int> pick(0, 19);
+    std::uniform_int_distribution<int> count(8, 40);
+    QByteArray record = "<div class=\"entry\"><b>" + headword + "</b> <span class=\"pos\">"
+                        + parts[rng() % 4] + "</span><br><div class=\"def\">";
+    for (int i = count(rng); i > 0; --i) {
+        record += words[pick(rng)];
+        record += ' ';
+    }
+    record += "</div><div class=\"ex\"><i>";
+    for (int i = count(rng) / 2; i > 0; --i) {
+        record += words[pick(rng)];
+        record += ' ';
+    }
+    record += "</i></div></div>";
+    record += '\0';
+    return record;
+}
+
+// Writes an engine 2.0, UTF-8, unencrypted file and returns the total size of
+// the decompressed records.
+qint64 writeMdx(const QString& path, int entries, Codec codec) {
+    std::mt19937 rng(20240601);
+    std::vector<QByteArray> keyBlocks;
+    QByteArray keyInfo;
+    QByteArray keyData;
+    QByteArray firstKey;
+    QByteArray lastKey;
+    int keysInBlock = 0;
+
+    std::vector<QByteArray> recordBlocks;
+    QByteArray recordInfo;
+    QByteArray recordData;
+    qint64 recordOffset = 0;
+
+    auto closeKeyBlock = [&]() {
+        QByteArray block = packBlock(keyData, codec);
+        appendNumber(keyInfo, quint64(keysInBlock));
+        for (const QByteArray& key : {firstKey, lastKey}) {
+            uchar size[2];
+            qToBigEndian<quint16>(quint16(key.size()), size);
+            keyInfo.append(reinterpret_cast<const char*>(size), 2);
+            keyInfo.append(key);
+            keyInfo.append('\0');
+        }
+        appendNumber(keyInfo, quint64(block.size()));
+        appendNumber(keyInfo, quint64(keyData.size()));
+        keyBlocks.push_back(block);
+        keyData.clear();
+        keysInBlock = 0;
+    };
+    auto closeRecordBlock = [&]() {
+        QByteArray block = packBlock(recordData, codec);
+        appendNumber(recordInfo, quint64(block.size()));
+        appendNumber(recordInfo, quint64(recordData.size()));
+        recordBlocks.push_back(block);
+        recordData.clear();
+    };
+
+    for (int i = 0; i < entries; ++i) {
+        const QByteArray headword = "word" + QByteArray::number(i).rightJustified(8, '0');
+        if (keysInBlock == 0) firstKey = headword;
+        lastKey = headword;
+        appendNumber(keyData, quint64(recordOffset));
+        keyData.append(headword);
+        keyData.append('\0');
+        if (++keysInBlock == kKeysPerBlock) closeKeyBlock();
+
+        const QByteArray record = makeRecord(headword, rng);
+        recordData.append(record);
+        recordOffset += record.size();
+        if (recordData.size() >= kRecordBlockSize) closeRecordBlock();
+    }
+    if (keysInBlock > 0) closeKeyBlock();
+    if (!recordData.isEmpty()) closeRecordBlock();
+
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) return -1;
+
+    const QString headerText = "<Dictionary GeneratedByEngineVersion=\"2.0\" RequiredEngineVersion=\"2.0\" "
+                               "Encrypted=\"0\" Encoding=\"UTF-8\" Format=\"Html\" Title=\"MdxBench\"/>\r\n";
+    QByteArray header(reinterpret_cast<const char*>(headerText.utf16()), headerText.size() * 2);
+    header.append(2, '\0');
+    QByteArray out;
+    uchar word[4];
+    qToBigEndian<quint32>(quint32(header.size()), word);
+    out.append(reinterpret_cast<const char*>(word), 4);
+    out.append(header);
+    qToLittleEndian<quint32>(adler32(header), word);
+    out.append(reinterpret_cast<const char*>(word), 4);
+
+    // Key block info is always zlib, as MDict writes it.
+    const QByteArray packedInfo = packBlock(keyInfo, Codec::Zlib);
+    qint64 keyBlocksSize = 0;
+    for (const QByteArray& block : keyBlocks) keyBlocksSize += block.size();
+    QByteArray keyHead;
+    appendNumber(keyHead, quint64(keyBlocks.size()));
+    appendNumber(keyHead, quint64(entries));
+    appendNumber(keyHead, quint64(keyInfo.size()));
+    appendNumber(keyHead, quint64(packedInfo.size()));
+    appendNumber(keyHead, quint64(keyBlocksSize));
+    out.append(keyHead);
+    qToBigEndian<quint32>(adler32(keyHead), word);
+    out.append(reinterpret_cast<const char*>(word), 4);
+    out.append(packedInfo);
+    file.write(out);
+    for (const QByteArray& block : keyBlocks) file.write(block);
+
+    qint64 recordBlocksSize = 0;
+    for (const QByteArray& block : recordBlocks) recordBlocksSize += block.size();
+    QByteArray recordHead;
+    appendNumber(recordHead, quint64(recordBlocks.size()));
+    appendNumber(recordHead, quint64(entries));
+    appendNumber(recordHead, quint64(recordInfo.size()));
+    appendNumber(recordHead, quint64(recordBlocksSize));
+    file.write(recordHead);
+    file.write(recordInfo);
+    for (const QByteArray& block : recordBlocks) file.write(block);
+    return file.error() == QFileDevice::NoError ? recordOffset : -1;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    const int entries = argc > 1 ? std::max(1, std::atoi(argv[1])) : 200000;
+    const QByteArray codecName = argc > 2 ? QByteArray(argv[2]) : QByteArray("zlib");
+    const int rounds = argc > 3 ? std::max(1, std::atoi(argv[3])) : 3;
+    Codec codec = Codec::Zlib;
+    if (codecName == "lzo") codec = Codec::Lzo;
+    else if (codecName == "none") codec = Codec::None;
+    else if (codecName != "zlib") {
+        std::fprintf(stderr, "unknown codec %s (zlib, lzo or none)\n", codecName.constData());
+        return 2;
+    }
+
+    QTemporaryDir dir;
+    const QString path = dir.filePath("bench.mdx");
+    const qint64 recordBytes = writeMdx(path, entries, codec);
+    if (recordBytes < 0) {
+        std::fprintf(stderr, "cannot write %s\n", qPrintable(path));
+        return 1;
+    }
+    std::printf("%d entries, %s blocks, %.1f MB on disk, %.1f MB of records\n", entries,
+                codecName.constData(), QFile(path).size() / 1e6, recordBytes / 1e6);
+
+    double best = 0.0;
+    for (int round = 0; round < rounds; ++round) {
+        qint64 parsed = 0;
+        MdxParser parser(path);
+        QElapsedTimer timer;
+        timer.start();
+        const bool ok = parser.parse([&parsed](QList<Word>& batch) {
+            parsed += batch.size();
+            return true;
+        });
+        const double secs = timer.nsecsElapsed() / 1e9;
+        if (!ok || parsed != entries) {
+            std::printf("parse failed after %lld entries: %s\n", static_cast<long long>(parsed),
+                        qPrintable(parser.errorString()));
+            return 1;
+        }
+        best = round == 0 ? secs : std::min(best, secs);
+    }
+
+    std::printf("parse: %.0f entries/s, %.1f MB/s of records (best of %d)\n",
+                entries / std::max(1e-9, best), recordBytes / 1e6 / std::max(1e-9, best), rounds);
+    return 0;
+}
@@ -0,0 +1,342 @@
+#include "AnkiImporter.h"
+#include "DictionaryParser.h"
+#include "FsrsScheduler.h"
+#include "../db/DatabaseManager.h"
+#include <QFile>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QDateTime>
+#include <QtEndian>
+#include <QDebug>
+#include <map>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+
+const int BATCH_SIZE = 5000;
+const qint64 CHUNK_SIZE = 256 * 1024;
+
+int findField(const QStringList& names, const QStringList& candidates) {
+    for (const QString& candidate : candidates) {
+        for (int i = 0; i < names.size(); ++i) {
+            if (names[i].trimmed().compare(candidate, Qt::CaseInsensitive) == 0) return i;
+        }
+    }
+    return -1;
+}
+
+}
+
+AnkiImporter::AnkiImporter(const QString& filePath)
+    : m_filePath(filePath), m_notes(0), m_cards(0) {
+}
+
+AnkiImporter::~AnkiImporter() {
+    if (m_connectionName.isEmpty()) return;
+    {
+        QSqlDatabase db = QSqlDatabase::database(m_connectionName, false);
+        if (db.isOpen()) db.close();
+    }
+    QSqlDatabase::removeDatabase(m_connectionName);
+}
+
+int AnkiImporter::importedNotes() const {
+    return m_notes;
+}
+
+int AnkiImporter::importedCards() const {
+    return m_cards;
+}
+
+QString AnkiImporter::errorString() const {
+    return m_error;
+}
+
+bool AnkiImporter::fail(const QString& message) {
+    m_error = message;
+    qWarning() << "AnkiImporter:" << m_filePath << message;
+    return false;
+}
+
+bool AnkiImporter::import(int bookId, const QSqlDatabase& db) {
+    m_target = db;
+    m_notes = 0;
+    m_cards = 0;
+    m_error.clear();
+    if (!m_tempDir.isValid()) return fail("cannot create temporary directory");
+
+    QString path = m_tempDir.filePath("collection.anki2");
+    if (!extractCollection(path) || !openCollection(path)) return false;
+
+    loadFieldMaps();
+    return importNotes(bookId) && importReviewHistory();
+}
+
+bool AnkiImporter::extractCollection(const QString& targetPath) {
+#ifndef HAVE_ZLIB
+    Q_UNUSED(targetPath);
+    return fail("built without zlib, cannot read .apkg packages");
+#else
+    QFile zip(m_filePath);
+    if (!zip.open(QIODevice::ReadOnly)) return fail(zip.errorString());
+
+    qint64 size = zip.size();
+    qint64 tailSize = qMin<qint64>(size, 0xFFFF + 22);
+    if (tailSize < 22 || !zip.seek(size - tailSize)) return fail("not a zip archive");
+    QByteArray tail = zip.read(tailSize);
+    qsizetype eocd = -1;
+    for (qsizetype i = tail.size() - 22; i >= 0; --i) {
+        if (qFromLittleEndian<quint32>(tail.constData() + i) == 0x06054b50) {
+            eocd = i;
+            break;
+        }
+    }
+    if (eocd < 0) return fail("not a zip archive");
+
+    const char *e = tail.constData() + eocd;
+    int entries = qFromLittleEndian<quint16>(e + 10);
+    quint32 cdSize = qFromLittleEndian<quint32>(e + 12);
+    quint32 cdOffset = qFromLittleEndian<quint32>(e + 16);
+    if (cdOffset == 0xFFFFFFFF || !zip.seek(cdOffset)) return fail("zip64 archives are not supported");
+    QByteArray cd = zip.read(cdSize);
+
+    struct Entry {
+        int method = -1;
+        quint32 compSize = 0;
+        quint32 localOffset = 0;
+    };
+    QHash<QString, Entry> files;
+    qsizetype p = 0;
+    for (int i = 0; i < entries && p + 46 <= cd.size(); ++i) {
+        const char *h = cd.constData() + p;
+        if (qFromLittleEndian<quint32>(h) != 0x02014b50) break;
+        int nameLen = qFromLittleEndian<quint16>(h + 28);
+        int extraLen = qFromLittleEndian<quint16>(h + 30);
+        int commentLen = qFromLittleEndian<quint16>(h + 32);
+        if (p + 46 + nameLen > cd.size()) break;
+        Entry entry;
+        entry.method = qFromLittleEndian<quint16>(h + 10);
+        entry.compSize = qFromLittleEndian<quint32>(h + 20);
+        entry.localOffset = qFromLittleEndian<quint32>(h + 42);
+        files.insert(QString::fromUtf8(h + 46, nameLen), entry);
+        p += 46 + nameLen + extraLen + commentLen;
+    }
+
+    QString name = files.contains("collection.anki21") ? "collection.anki21" : "collection.anki2";
+    if (!files.contains(name)) {
+        if (files.contains("collection.anki21b")) {
+            return fail("zstd-compressed collections are not supported, export with \"Support older Anki versions\"");
+        }
+        return fail("no collection in package");
+    }
+    const Entry entry = files.value(name);
+
+    if (!zip.seek(entry.localOffset)) return fail("corrupt zip entry");
+    QByteArray local = zip.read(30);
+    if (local.size() != 30 || qFromLittleEndian<quint32>(local.constData()) != 0x04034b50) {
+        return fail("corrupt zip entry");
+    }
+    qint64 dataOffset = qint64(entry.localOffset) + 30
+        + qFromLittleEndian<quint16>(local.constData() + 26)
+        + qFromLittleEndian<quint16>(local.constData() + 28);
+    if (!zip.seek(dataOffset)) return fail("corrupt zip entry");
+
+    QFile out(targetPath);
+    if (!out.open(QIODevice::WriteOnly)) return fail(out.errorString());
+
+    qint64 remaining = entry.compSize;
+    if (entry.method == 0) {
+        while (remaining > 0) {
+            QByteArray chunk = zip.read(qMin(remaining, CHUNK_SIZE));
+            if (chunk.isEmpty()) return fail("truncated zip entry");
+            out.write(chunk);
+            remaining -= chunk.size();
+        }
+        return true;
+    }
+    if (entry.method != 8) return fail(QString("unsupported zip compression method %1").arg(entry.method));
+
+    z_stream zs = {};
+    if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) return fail("cannot initialise zlib");
+    QByteArray outBuffer(int(CHUNK_SIZE), Qt::Uninitialized);
+    int ret = Z_OK;
+    while (ret != Z_STREAM_END && remaining > 0) {
+        QByteArray chunk = zip.read(qMin(remaining, CHUNK_SIZE));
+        if (chunk.isEmpty()) break;
+        remaining -= chunk.size();
+        zs.next_in = reinterpret_cast<Bytef*>(chunk.data());
+        zs.avail_in = uInt(chunk.size());
+        do {
+            zs.next_out = reinterpret_cast<Bytef*>(outBuffer.data());
+            zs.avail_out = uInt(outBuffer.size());
+            ret = inflate(&zs, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                inflateEnd(&zs);
+                return fail("corrupt deflate stream");
+            }
+            out.write(outBuffer.constData(), outBuffer.size() - qsizetype(zs.avail_out));
+        } while (zs.avail_out == 0 && ret != Z_STREAM_END);
+    }
+    inflateEnd(&zs);
+    if (ret != Z_STREAM_END) return fail("truncated deflate stream");
+    return true;
+#endif
+}
+
+bool AnkiImporter::openCollection(const QString& path) {
+    m_connectionName = QString("anki_import_%1").arg(quintptr(this));
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", m_connectionName);
+    db.setDatabaseName(path);
+    db.setConnectOptions("QSQLITE_OPEN_READONLY");
+    if (!db.open()) return fail(db.lastError().text());
+    return true;
+}
+
+void AnkiImporter::loadFieldMaps() {
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+    QHash<qint64, QStringList> fieldNames;
+
+    QSqlQuery query(db);
+    if (query.exec("SELECT ntid, name FROM fields ORDER BY ntid, ord")) {
+        while (query.next()) {
+            fieldNames[query.value(0).toLongLong()].append(query.value(1).toString());
+        }
+    } else if (query.exec("SELECT models FROM col") && query.next()) {
+        QJsonObject models = QJsonDocument::fromJson(query.value(0).toByteArray()).object();
+        for (auto it = models.constBegin(); it != models.constEnd(); ++it) {
+            std::map<int, QString> ordered;
+            for (const QJsonValue& fld : it.value().toObject().value("flds").toArray()) {
+                QJsonObject obj = fld.toObject();
+                ordered[obj.value("ord").toInt()] = obj.value("name").toString();
+            }
+            QStringList names;
+            for (const auto& entry : ordered) names.append(entry.second);
+            fieldNames[it.key().toLongLong()] = names;
+        }
+    }
+
+    for (auto it = fieldNames.constBegin(); it != fieldNames.constEnd(); ++it) {
+        const QStringList& names = it.value();
+        FieldMap map;
+        int spelling = findField(names, {"Word", "单词", "Front", "Expression", "Vocabulary", "Term", "Headword"});
+        int definition = findField(names, {"Meaning", "释义", "Definition", "Translation", "Back", "Gloss"});
+        map.spelling = spelling >= 0 ? spelling : 0;
+        map.definition = definition >= 0 ? definition : (names.size() > 1 ? 1 : -1);
+        map.phonetic = findField(names, {"Phonetic", "音标", "IPA", "Pronunciation", "Reading"});
+        map.example = findField(names, {"Example", "例句", "Sentence", "Examples"});
+        m_fieldMaps.insert(it.key(), map);
+    }
+}
+
+bool AnkiImporter::importNotes(int bookId) {
+    QSqlQuery query(QSqlDatabase::database(m_connectionName));
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT id, mid, flds, tags FROM notes ORDER BY id")) {
+        return fail(query.lastError().text());
+    }
+
+    QList<Word> batch;
+    QList<qint64> batchNotes;
+    auto flush = [&]() {
+        if (!DatabaseManager::instance().addWords(batch, m_target)) return false;
+        for (int i = 0; i < batch.size(); ++i) {
+            m_noteToWord.insert(batchNotes[i], batch[i].id);
+        }
+        m_notes += batch.size();
+        batch.clear();
+        batchNotes.clear();
+        return true;
+    };
+
+    while (query.next()) {
+        qint64 noteId = query.value(0).toLongLong();
+        FieldMap map = m_fieldMaps.value(query.value(1).toLongLong());
+        QStringList fields = query.value(2).toString().split(QChar(0x1f));
+        auto field = [&fields](int i) {
+            return i >= 0 && i < fields.size() ? DictionaryParser::htmlToText(fields[i]) : QString();
+        };
+
+        Word w;
+        w.bookId = bookId;
+        w.spelling = field(map.spelling);
+        w.phonetic = field(map.phonetic);
+        w.definition = field(map.definition);
+        w.example = field(map.example);
+        w.tags = query.value(3).toString().split(' ', Qt::SkipEmptyParts);
+        w.createdAt = QDateTime::fromMSecsSinceEpoch(noteId);
+        if (w.spelling.isEmpty()) continue;
+
+        batch.append(w);
+        batchNotes.append(noteId);
+        if (batch.size() >= BATCH_SIZE && !flush()) return fail("failed to insert notes");
+    }
+    if (!batch.isEmpty() && !flush()) return fail("failed to insert notes");
+    return true;
+}
+
+bool AnkiImporter::importReviewHistory() {
+    QSqlQuery query(QSqlDatabase::database(m_connectionName));
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT c.nid, r.id, r.ease, r.type FROM revlog r JOIN cards c ON c.id = r.cid "
+                    "ORDER BY c.nid, r.id")) {
+        return fail(query.lastError().text());
+    }
+
+    FsrsScheduler scheduler;
+    QList<FsrsCard> batch;
+    QList<ReviewLog> logs;
+    qint64 currentNote = -1;
+    FsrsCard card;
+
+    auto finishCard = [&]() {
+        if (card.wordId >= 0 && card.reps > 0) batch.append(card);
+        if (batch.size() < BATCH_SIZE) return true;
+        if (!DatabaseManager::instance().addCards(batch, m_target)) return false;
+        if (!DatabaseManager::instance().addReviewLogs(logs, m_target)) return false;
+        for (const FsrsCard& c : batch) m_cards += c.id >= 0;
+        batch.clear();
+        logs.clear();
+        return true;
+    };
+
+    while (query.next()) {
+        qint64 noteId = query.value(0).toLongLong();
+        if (noteId != currentNote) {
+            if (!finishCard()) return fail("failed to insert cards");
+            currentNote = noteId;
+            card = FsrsCard();
+            card.wordId = m_noteToWord.value(noteId, -1);
+        }
+        if (card.wordId < 0) continue;
+
+        int ease = query.value(2).toInt();
+        int type = query.value(3).toInt();
+        if (ease < FsrsRating::Again || ease > FsrsRating::Easy || type == 4) continue;
+
+        QDateTime reviewedAt = QDateTime::fromMSecsSinceEpoch(query.value(1).toLongLong());
+        if (card.lastReview.isValid()) {
+            card.elapsedDays = int(card.lastReview.daysTo(reviewedAt));
+        }
+        ReviewLog log;
+        log.wordId = card.wordId;
+        log.rating = ease;
+        log.state = card.state;
+        log.elapsedDays = card.elapsedDays;
+        log.reviewedAt = reviewedAt;
+        card = scheduler.schedule(card, static_cast<FsrsRating::Rating>(ease), reviewedAt);
+        log.scheduledDays = card.scheduledDays;
+        logs.append(log);
+    }
+    if (!finishCard()) return fail("failed to insert cards");
+    if (!batch.isEmpty()) {
+        if (!DatabaseManager::instance().addCards(batch, m_target)
+            || !DatabaseManager::instance().addReviewLogs(logs, m_target)) return fail("failed to insert cards");
+        for (const FsrsCard& c : batch) m_cards += c.id >= 0;
+    }
+    return true;
+}
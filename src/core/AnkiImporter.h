@@ -0,0 +1,49 @@
+#pragma once
+#include "Word.h"
+#include <QSqlDatabase>
+#include <QHash>
+#include <QString>
+#include <QTemporaryDir>
+
+// Imports an Anki package (.apkg): notes become words of a book and each
+// note's review log is replayed through FsrsScheduler into a `cards` row.
+// A note with several Anki cards (e.g. forward and reverse) has one word
+// here, so the reviews of all its cards are merged in time order.
+class AnkiImporter {
+public:
+    explicit AnkiImporter(const QString& filePath);
+    ~AnkiImporter();
+
+    // Writes through `db` when given, so the import can run off the UI
+    // thread on a connection of its own.
+    bool import(int bookId, const QSqlDatabase& db = QSqlDatabase());
+
+    int importedNotes() const;
+    int importedCards() const;
+    QString errorString() const;
+
+private:
+    struct FieldMap {
+        int spelling = 0;
+        int phonetic = -1;
+        int definition = 1;
+        int example = -1;
+    };
+
+    bool extractCollection(const QString& targetPath);
+    bool openCollection(const QString& path);
+    void loadFieldMaps();
+    bool importNotes(int bookId);
+    bool importReviewHistory();
+    bool fail(const QString& message);
+
+    QString m_filePath;
+    QString m_connectionName;
+    QSqlDatabase m_target;
+    QTemporaryDir m_tempDir;
+    QString m_error;
+    QHash<qint64, FieldMap> m_fieldMaps;
+    QHash<qint64, int> m_noteToWord;
+    int m_notes;
+    int m_cards;
+};
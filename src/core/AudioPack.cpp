@@ -0,0 +1,239 @@
+#include "AudioPack.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const char PACK_MAGIC[4] = {'A', 'W', 'A', 'P'};
+const quint32 PACK_VERSION = 1;
+const int HEADER_SIZE = 32;
+const int FORMAT_SIZE = 8;
+const int ENTRY_SIZE = 24;
+const char *const CLIP_FORMATS[] = {"mp3", "ogg", "opus", "m4a", "wav"};
+
+quint32 readU32(const uchar *p) {
+    return qFromLittleEndian<quint32>(p);
+}
+
+quint64 readU64(const uchar *p) {
+    return qFromLittleEndian<quint64>(p);
+}
+
+void appendU32(QByteArray& out, quint32 value) {
+    uchar buf[4];
+    qToLittleEndian(value, buf);
+    out.append(reinterpret_cast<const char*>(buf), 4);
+}
+
+void appendU64(QByteArray& out, quint64 value) {
+    uchar buf[8];
+    qToLittleEndian(value, buf);
+    out.append(reinterpret_cast<const char*>(buf), 8);
+}
+
+}
+
+AudioPack::AudioPack()
+    : m_data(nullptr), m_size(0), m_count(0), m_entries(nullptr), m_pool(nullptr), m_poolSize(0) {
+}
+
+AudioPack::~AudioPack() {
+    close();
+}
+
+bool AudioPack::compile(const QString& clipDir, const QString& packPath) {
+    QDir dir(clipDir);
+    QString format;
+    int formatCount = 0;
+    for (const char *candidate : CLIP_FORMATS) {
+        int n = dir.entryList({QStringLiteral("*.") + candidate}, QDir::Files).size();
+        if (n > formatCount) {
+            format = QString::fromLatin1(candidate);
+            formatCount = n;
+        }
+    }
+
+    struct Clip {
+        QByteArray key;
+        QString path;
+        qint64 size;
+    };
+    std::vector<Clip> clips;
+    const QFileInfoList files = dir.entryInfoList({"*." + format}, QDir::Files, QDir::Name);
+    for (const QFileInfo& info : files) {
+        if (info.size() > 0xFFFFFFFFll) continue;
+        clips.push_back({info.completeBaseName().trimmed().toLower().toUtf8(), info.filePath(), info.size()});
+    }
+    if (format.isEmpty() || clips.empty()) {
+        qWarning() << "AudioPack: no audio clips in" << clipDir;
+        return false;
+    }
+    std::stable_sort(clips.begin(), clips.end(), [](const Clip& a, const Clip& b) {
+        return a.key < b.key;
+    });
+    // One clip per key; the first file in name order wins.
+    clips.erase(std::unique(clips.begin(), clips.end(), [](const Clip& a, const Clip& b) {
+        return a.key == b.key;
+    }), clips.end());
+
+    QByteArray pool;
+    for (const Clip& c : clips) pool.append(c.key);
+    const quint32 entriesOffset = HEADER_SIZE;
+    const quint64 poolOffset = entriesOffset + quint64(clips.size()) * ENTRY_SIZE;
+    const quint64 dataOffset = poolOffset + quint64(pool.size());
+
+    QByteArray entries;
+    entries.reserve(int(clips.size()) * ENTRY_SIZE);
+    quint32 keyOffset = 0;
+    quint64 clipOffset = dataOffset;
+    for (const Clip& c : clips) {
+        appendU32(entries, keyOffset);
+        appendU32(entries, quint32(c.key.size()));
+        appendU64(entries, clipOffset);
+        appendU32(entries, quint32(c.size));
+        appendU32(entries, 0);
+        keyOffset += quint32(c.key.size());
+        clipOffset += quint64(c.size);
+    }
+
+    QByteArray header(PACK_MAGIC, 4);
+    appendU32(header, PACK_VERSION);
+    appendU32(header, quint32(clips.size()));
+    appendU32(header, quint32(poolOffset));
+    appendU32(header, quint32(pool.size()));
+    appendU32(header, 0);
+    header.append(format.toLatin1().leftJustified(FORMAT_SIZE, '\0'));
+
+    QSaveFile file(packPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "AudioPack: cannot write" << packPath << file.errorString();
+        return false;
+    }
+    file.write(header);
+    file.write(entries);
+    file.write(pool);
+    for (const Clip& c : clips) {
+        QFile clip(c.path);
+        QByteArray bytes;
+        if (clip.open(QIODevice::ReadOnly)) bytes = clip.readAll();
+        if (bytes.size() != c.size) {
+            qWarning() << "AudioPack: cannot read" << c.path;
+            file.cancelWriting();
+            return false;
+        }
+        file.write(bytes);
+    }
+    return file.commit();
+}
+
+bool AudioPack::open(const QString& packPath) {
+    close();
+    m_file.setFileName(packPath);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qWarning() << "AudioPack: cannot open" << packPath << m_file.errorString();
+        return false;
+    }
+
+    m_size = m_file.size();
+    if (m_size >= HEADER_SIZE) {
+        m_data = m_file.map(0, m_size);
+    }
+    if (!m_data || std::memcmp(m_data, PACK_MAGIC, 4) != 0 || readU32(m_data + 4) != PACK_VERSION) {
+        qWarning() << "AudioPack: not an audio pack" << packPath;
+        close();
+        return false;
+    }
+
+    quint32 count = readU32(m_data + 8);
+    quint64 poolOffset = readU32(m_data + 12);
+    quint64 poolSize = readU32(m_data + 16);
+    if (HEADER_SIZE + quint64(count) * ENTRY_SIZE > poolOffset || poolOffset + poolSize > quint64(m_size)) {
+        qWarning() << "AudioPack: truncated pack" << packPath;
+        close();
+        return false;
+    }
+
+    m_count = count;
+    m_entries = m_data + HEADER_SIZE;
+    m_pool = m_data + poolOffset;
+    m_poolSize = quint32(poolSize);
+    const char *format = reinterpret_cast<const char*>(m_data + 24);
+    m_format = QString::fromLatin1(format, qstrnlen(format, FORMAT_SIZE));
+    return true;
+}
+
+void AudioPack::close() {
+    if (m_data) {
+        m_file.unmap(const_cast<uchar*>(m_data));
+    }
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_count = 0;
+    m_entries = nullptr;
+    m_pool = nullptr;
+    m_poolSize = 0;
+    m_format.clear();
+}
+
+bool AudioPack::isOpen() const {
+    return m_data != nullptr;
+}
+
+QString AudioPack::fileName() const {
+    return m_file.fileName();
+}
+
+int AudioPack::count() const {
+    return int(m_count);
+}
+
+QString AudioPack::format() const {
+    return m_format;
+}
+
+int AudioPack::find(const QString& spelling) const {
+    QByteArray needleKey = spelling.trimmed().toLower().toUtf8();
+    std::string_view needle(needleKey.constData(), size_t(needleKey.size()));
+
+    int lo = 0;
+    int hi = int(m_count);
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (key(mid) < needle) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < int(m_count) && key(lo) == needle) {
+        return lo;
+    }
+    return -1;
+}
+
+QByteArray AudioPack::clip(int entry) const {
+    if (entry < 0 || quint32(entry) >= m_count) return QByteArray();
+    const uchar *e = m_entries + quint64(entry) * ENTRY_SIZE;
+    quint64 offset = readU64(e + 8);
+    quint32 length = readU32(e + 16);
+    if (offset + length > quint64(m_size)) return QByteArray();
+    return QByteArray::fromRawData(reinterpret_cast<const char*>(m_data + offset), qsizetype(length));
+}
+
+std::string_view AudioPack::key(int entry) const {
+    if (entry < 0 || quint32(entry) >= m_count) return {};
+    const uchar *e = m_entries + quint64(entry) * ENTRY_SIZE;
+    quint32 offset = readU32(e);
+    quint32 length = readU32(e + 4);
+    if (quint64(offset) + length > m_poolSize) return {};
+    return std::string_view(reinterpret_cast<const char*>(m_pool + offset), length);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <string_view>
+
+// Read-only archive of recorded pronunciations, mapped straight from disk.
+// Layout (little-endian): Header | Entry[count] | key pool | clip data.
+// Entries are sorted by the lower-cased UTF-8 spelling key; each holds its
+// key and a 64-bit offset and length of one compressed clip. All clips share
+// the container format named in the header (e.g. "mp3", "ogg").
+class AudioPack {
+public:
+    AudioPack();
+    ~AudioPack();
+
+    // Packs every <spelling>.<ext> file of a folder. The most common of
+    // mp3, ogg, opus, m4a and wav becomes the pack format; other files are
+    // skipped.
+    static bool compile(const QString& clipDir, const QString& packPath);
+
+    bool open(const QString& packPath);
+    void close();
+    bool isOpen() const;
+    QString fileName() const;
+
+    int count() const;
+    QString format() const;
+    int find(const QString& spelling) const;
+    // Wraps the mapped bytes without copying; valid until close().
+    QByteArray clip(int entry) const;
+
+private:
+    std::string_view key(int entry) const;
+
+    QFile m_file;
+    const uchar *m_data;
+    qint64 m_size;
+    quint32 m_count;
+    const uchar *m_entries;
+    const uchar *m_pool;
+    quint32 m_poolSize;
+    QString m_format;
+};
@@ -0,0 +1,228 @@
+#include "DictionaryPack.h"
+#include "DictionaryParser.h"
+#include <QSaveFile>
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const char PACK_MAGIC[4] = {'A', 'W', 'D', 'P'};
+const quint32 PACK_VERSION = 1;
+const int HEADER_SIZE = 32;
+const int RECORD_SIZE = DictionaryPack::FieldCount * 8;
+
+quint32 readU32(const uchar *p) {
+    return qFromLittleEndian<quint32>(p);
+}
+
+void appendU32(QByteArray& out, quint32 value) {
+    uchar buf[4];
+    qToLittleEndian(value, buf);
+    out.append(reinterpret_cast<const char*>(buf), 4);
+}
+
+}
+
+DictionaryPack::DictionaryPack()
+    : m_data(nullptr), m_size(0), m_count(0), m_records(nullptr), m_index(nullptr), m_pool(nullptr), m_poolSize(0) {
+}
+
+DictionaryPack::~DictionaryPack() {
+    close();
+}
+
+bool DictionaryPack::compile(const QString& sourcePath, const QString& packPath) {
+    QList<Word> words = DictionaryParser::parseFile(sourcePath);
+    if (words.isEmpty()) {
+        qWarning() << "DictionaryPack: no words parsed from" << sourcePath;
+        return false;
+    }
+    return compile(words, packPath);
+}
+
+bool DictionaryPack::compile(const QList<Word>& words, const QString& packPath) {
+    QByteArray pool;
+    QByteArray records;
+    records.reserve(words.size() * RECORD_SIZE);
+    std::vector<std::pair<quint32, quint32>> keys;
+    keys.reserve(words.size());
+
+    for (const Word& w : words) {
+        // The key is normalized exactly as find() normalizes its query.
+        const QByteArray fields[FieldCount] = {
+            w.spelling.trimmed().toLower().toUtf8(),
+            w.spelling.toUtf8(),
+            w.phonetic.toUtf8(),
+            w.definition.toUtf8(),
+            w.example.toUtf8(),
+            w.tags.join(";").toUtf8()
+        };
+        for (int f = 0; f < FieldCount; ++f) {
+            if (quint64(pool.size()) + quint64(fields[f].size()) > 0xFFFFFFFFull) {
+                qWarning() << "DictionaryPack: string pool exceeds 4 GiB";
+                return false;
+            }
+            if (f == Key) keys.emplace_back(quint32(pool.size()), quint32(fields[f].size()));
+            appendU32(records, quint32(pool.size()));
+            appendU32(records, quint32(fields[f].size()));
+            pool.append(fields[f]);
+        }
+    }
+
+    std::vector<quint32> order(words.size());
+    for (quint32 i = 0; i < order.size(); ++i) order[i] = i;
+    const char *poolData = pool.constData();
+    std::stable_sort(order.begin(), order.end(), [&](quint32 a, quint32 b) {
+        std::string_view ka(poolData + keys[a].first, keys[a].second);
+        std::string_view kb(poolData + keys[b].first, keys[b].second);
+        return ka < kb;
+    });
+
+    QByteArray index;
+    index.reserve(int(order.size()) * 4);
+    for (quint32 r : order) appendU32(index, r);
+
+    const quint32 recordsOffset = HEADER_SIZE;
+    const quint32 indexOffset = recordsOffset + quint32(records.size());
+    const quint32 poolOffset = indexOffset + quint32(index.size());
+
+    QByteArray header(PACK_MAGIC, 4);
+    appendU32(header, PACK_VERSION);
+    appendU32(header, quint32(words.size()));
+    appendU32(header, recordsOffset);
+    appendU32(header, indexOffset);
+    appendU32(header, poolOffset);
+    appendU32(header, quint32(pool.size()));
+    appendU32(header, 0);
+
+    QSaveFile file(packPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "DictionaryPack: cannot write" << packPath << file.errorString();
+        return false;
+    }
+    file.write(header);
+    file.write(records);
+    file.write(index);
+    file.write(pool);
+    return file.commit();
+}
+
+bool DictionaryPack::open(const QString& packPath) {
+    close();
+    m_file.setFileName(packPath);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qWarning() << "DictionaryPack: cannot open" << packPath << m_file.errorString();
+        return false;
+    }
+
+    m_size = m_file.size();
+    if (m_size >= HEADER_SIZE) {
+        m_data = m_file.map(0, m_size);
+    }
+    if (!m_data || std::memcmp(m_data, PACK_MAGIC, 4) != 0 || readU32(m_data + 4) != PACK_VERSION) {
+        qWarning() << "DictionaryPack: not a dictionary pack" << packPath;
+        close();
+        return false;
+    }
+
+    quint32 count = readU32(m_data + 8);
+    quint64 recordsOffset = readU32(m_data + 12);
+    quint64 indexOffset = readU32(m_data + 16);
+    quint64 poolOffset = readU32(m_data + 20);
+    quint64 poolSize = readU32(m_data + 24);
+    if (recordsOffset + quint64(count) * RECORD_SIZE > quint64(m_size) ||
+        indexOffset + quint64(count) * 4 > quint64(m_size) ||
+        poolOffset + poolSize > quint64(m_size)) {
+        qWarning() << "DictionaryPack: truncated pack" << packPath;
+        close();
+        return false;
+    }
+
+    m_count = count;
+    m_records = m_data + recordsOffset;
+    m_index = m_data + indexOffset;
+    m_pool = m_data + poolOffset;
+    m_poolSize = quint32(poolSize);
+    return true;
+}
+
+void DictionaryPack::close() {
+    if (m_data) {
+        m_file.unmap(const_cast<uchar*>(m_data));
+    }
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_count = 0;
+    m_records = nullptr;
+    m_index = nullptr;
+    m_pool = nullptr;
+    m_poolSize = 0;
+}
+
+bool DictionaryPack::isOpen() const {
+    return m_data != nullptr;
+}
+
+QString DictionaryPack::fileName() const {
+    return m_file.fileName();
+}
+
+int DictionaryPack::count() const {
+    return int(m_count);
+}
+
+int DictionaryPack::recordAt(int sortedPos) const {
+    if (sortedPos < 0 || quint32(sortedPos) >= m_count) return -1;
+    quint32 record = readU32(m_index + quint64(sortedPos) * 4);
+    return record < m_count ? int(record) : -1;
+}
+
+int DictionaryPack::find(const QString& spelling) const {
+    QByteArray key = spelling.trimmed().toLower().toUtf8();
+    std::string_view needle(key.constData(), size_t(key.size()));
+
+    int lo = 0;
+    int hi = int(m_count);
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (rawField(recordAt(mid), Key) < needle) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < int(m_count) && rawField(recordAt(lo), Key) == needle) {
+        return recordAt(lo);
+    }
+    return -1;
+}
+
+std::string_view DictionaryPack::rawField(int record, Field field) const {
+    if (record < 0 || quint32(record) >= m_count || field < 0 || field >= FieldCount) return {};
+    const uchar *rec = m_records + quint64(record) * RECORD_SIZE + field * 8;
+    quint32 offset = readU32(rec);
+    quint32 length = readU32(rec + 4);
+    if (quint64(offset) + length > m_poolSize) return {};
+    return std::string_view(reinterpret_cast<const char*>(m_pool + offset), length);
+}
+
+QString DictionaryPack::field(int record, Field field) const {
+    std::string_view raw = rawField(record, field);
+    return QString::fromUtf8(raw.data(), qsizetype(raw.size()));
+}
+
+Word DictionaryPack::word(int record) const {
+    Word w;
+    w.spelling = field(record, Spelling);
+    w.phonetic = field(record, Phonetic);
+    w.definition = field(record, Definition);
+    w.example = field(record, Example);
+    w.tags = field(record, Tags).split(';', Qt::SkipEmptyParts);
+    return w;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "Word.h"
+#include <QFile>
+#include <QList>
+#include <QString>
+#include <string_view>
+
+// Read-only binary word list, mapped straight from disk.
+// Layout (little-endian): Header | Record[count] | quint32 index[count] | string pool.
+// The index holds record numbers sorted by the trimmed, lower-cased UTF-8 spelling key.
+class DictionaryPack {
+public:
+    enum Field {
+        Key,
+        Spelling,
+        Phonetic,
+        Definition,
+        Example,
+        Tags,
+        FieldCount
+    };
+
+    DictionaryPack();
+    ~DictionaryPack();
+
+    static bool compile(const QString& sourcePath, const QString& packPath);
+    static bool compile(const QList<Word>& words, const QString& packPath);
+
+    bool open(const QString& packPath);
+    void close();
+    bool isOpen() const;
+    QString fileName() const;
+
+    int count() const;
+    int recordAt(int sortedPos) const;
+    int find(const QString& spelling) const;
+
+    std::string_view rawField(int record, Field field) const;
+    QString field(int record, Field field) const;
+    Word word(int record) const;
+
+private:
+    QFile m_file;
+    const uchar *m_data;
+    qint64 m_size;
+    quint32 m_count;
+    const uchar *m_records;
+    const uchar *m_index;
+    const uchar *m_pool;
+    quint32 m_poolSize;
+};
@@ -1,4 +1,5 @@
 #include "DictionaryParser.h"
+#include "MdxParser.h"
 #include <QFile>
 #include <QTextStream>
 #include <QFileInfo>
@@ -17,6 +18,8 @@ QList<Word> DictionaryParser::parseFile(const QString& filePath) {
         return parseJson(filePath);
     } else if (suffix == "txt") {
         return parseTxt(filePath);
+    } else if (suffix == "mdx") {
+        return MdxParser::parseFile(filePath);
     } else {
         return parseCsv(filePath);
     }
@@ -199,3 +202,28 @@ QList<Word> DictionaryParser::parseTxt(const QString& filePath) {
     }
     return words;
 }
+
+QString DictionaryParser::htmlToText(QString html) {
+    static const QRegularExpression reHidden("<(style|script)\\b[^>]*>.*?</\\1\\s*>",
+        QRegularExpression::CaseInsensitiveOption | QRegularExpression::DotMatchesEverythingOption);
+    static const QRegularExpression reBreak("<\\s*(br|/p|/div|/li|/h\\d)\\b[^>]*>", QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression reTag("<[^>]*>");
+    static const QRegularExpression reSpaces("[ \\t\\r]+");
+    static const QRegularExpression reLines("\\s*\\n\\s*");
+    static const QRegularExpression reSound("\\[sound:[^\\]]*\\]");
+
+    html.remove(reHidden);
+    html.remove(reSound);
+    html.replace(reBreak, "\n");
+    html.remove(reTag);
+    html.replace("&nbsp;", " ");
+    html.replace("&lt;", "<");
+    html.replace("&gt;", ">");
+    html.replace("&quot;", "\"");
+    html.replace("&#39;", "'");
+    html.replace("&amp;", "&");
+    html.replace(reSpaces, " ");
+    html.replace(reLines, "\n");
+    return html.trimmed();
+}
+
@@ -6,6 +6,7 @@
 class DictionaryParser {
 public:
     static QList<Word> parseFile(const QString& filePath);
+    static QString htmlToText(QString html);
 
 private:
     static QList<Word> parseCsv(const QString& filePath);
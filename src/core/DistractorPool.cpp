@@ -0,0 +1,88 @@
+#include "DistractorPool.h"
+#include <QRandomGenerator>
+#include <QSqlQuery>
+#include <QDebug>
+#include <numeric>
+#include <utility>
+
+bool DistractorPool::load(const QSqlDatabase& db, int bookId) {
+    clear();
+    m_bookId = bookId;
+
+    QString sql = "SELECT id, definition FROM words";
+    if (bookId != -1) {
+        sql += QString(" WHERE book_id = %1").arg(bookId);
+    } else {
+        sql += " GROUP BY id";
+    }
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.exec(sql)) {
+        qWarning() << "DistractorPool: failed to load book" << bookId;
+        return false;
+    }
+    while (query.next()) {
+        m_indexOf.insert(query.value(0).toInt(), int(m_ids.size()));
+        m_ids.append(query.value(0).toInt());
+        m_definitions.append(query.value(1).toString());
+    }
+    m_perm.resize(m_ids.size());
+    std::iota(m_perm.begin(), m_perm.end(), 0);
+    return true;
+}
+
+void DistractorPool::clear() {
+    m_bookId = -1;
+    m_ids.clear();
+    m_definitions.clear();
+    m_indexOf.clear();
+    m_perm.clear();
+}
+
+int DistractorPool::size() const {
+    return int(m_ids.size());
+}
+
+int DistractorPool::bookId() const {
+    return m_bookId;
+}
+
+QList<int> DistractorPool::sample(int k, const QList<int>& excludeIds) {
+    QList<int> picked;
+    const int n = int(m_perm.size());
+
+    QList<int> excluded;
+    for (int id : excludeIds) {
+        int index = indexOf(id);
+        if (index >= 0) excluded.append(index);
+    }
+
+    // Excluded entries are drawn like any other and skipped, so the cost
+    // stays O(k + excluded).
+    std::vector<std::pair<int, int>> swaps;
+    QRandomGenerator *rng = QRandomGenerator::global();
+    for (int i = 0; i < n && picked.size() < k; ++i) {
+        const int j = i + int(rng->bounded(quint32(n - i)));
+        std::swap(m_perm[i], m_perm[j]);
+        swaps.emplace_back(i, j);
+        if (!excluded.contains(m_perm[i])) picked.append(m_perm[i]);
+    }
+
+    // Undo in reverse so the permutation is the identity again.
+    for (auto it = swaps.rbegin(); it != swaps.rend(); ++it) {
+        std::swap(m_perm[it->first], m_perm[it->second]);
+    }
+    return picked;
+}
+
+int DistractorPool::indexOf(int id) const {
+    return m_indexOf.value(id, -1);
+}
+
+int DistractorPool::idAt(int index) const {
+    return m_ids[index];
+}
+
+const QString& DistractorPool::definitionAt(int index) const {
+    return m_definitions[index];
+}
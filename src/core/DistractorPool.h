@@ -0,0 +1,33 @@
+#pragma once
+#include <QHash>
+#include <QList>
+#include <QSqlDatabase>
+#include <QStringList>
+#include <vector>
+
+// Ids and definitions of one book, loaded once per test. Distractors are
+// drawn with a partial Fisher-Yates shuffle over an index permutation that
+// is restored after every draw, so each question costs O(k) regardless of
+// the book size.
+class DistractorPool {
+public:
+    bool load(const QSqlDatabase& db, int bookId);
+    void clear();
+
+    int size() const;
+    int bookId() const;
+
+    // Up to k distinct indices, none of them holding one of excludeIds.
+    QList<int> sample(int k, const QList<int>& excludeIds);
+
+    int indexOf(int id) const;
+    int idAt(int index) const;
+    const QString& definitionAt(int index) const;
+
+private:
+    int m_bookId = -1;
+    QList<int> m_ids;
+    QStringList m_definitions;
+    QHash<int, int> m_indexOf;
+    std::vector<int> m_perm;
+};
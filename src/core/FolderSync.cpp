@@ -0,0 +1,237 @@
+#include "FolderSync.h"
+#include "DictionaryParser.h"
+#include "../db/DatabaseManager.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QtEndian>
+#include <QDebug>
+
+FolderSync::FolderSync(QObject *parent)
+    : QObject(parent), m_worker(new QObject), m_generation(0), m_syncing(false), m_stopping(false) {
+    m_connection = QString("folder-sync-%1").arg(quintptr(this), 0, 16);
+    m_worker->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_worker, &QObject::deleteLater);
+    m_thread.start(QThread::LowPriority);
+
+    m_watcher = new QFileSystemWatcher(this);
+    connect(m_watcher, &QFileSystemWatcher::directoryChanged, this, &FolderSync::onDirectoryChanged);
+    connect(m_watcher, &QFileSystemWatcher::fileChanged, this, &FolderSync::onFileChanged);
+
+    m_debounce = new QTimer(this);
+    m_debounce->setSingleShot(true);
+    m_debounce->setInterval(500);
+    connect(m_debounce, &QTimer::timeout, this, &FolderSync::flushPending);
+}
+
+FolderSync::~FolderSync() {
+    // A running sync stops after the file it is on.
+    m_stopping = true;
+    m_thread.quit();
+    m_thread.wait();
+}
+
+void FolderSync::setFolder(const QString& path) {
+    if (path == m_folder) return;
+
+    if (!m_watcher->files().isEmpty()) m_watcher->removePaths(m_watcher->files());
+    if (!m_watcher->directories().isEmpty()) m_watcher->removePaths(m_watcher->directories());
+    m_pending.clear();
+    m_fileHashes.clear();
+    m_folder = path;
+    // A sync still running for the old folder finishes, but its results
+    // no longer touch the hashes.
+    m_generation++;
+
+    if (m_folder.isEmpty() || !QFileInfo(m_folder).isDir()) return;
+    m_watcher->addPath(m_folder);
+    watchFiles();
+    const QStringList files = m_watcher->files();
+    m_pending = QSet<QString>(files.begin(), files.end());
+    m_debounce->start();
+}
+
+QString FolderSync::folder() const {
+    return m_folder;
+}
+
+bool FolderSync::isWordList(const QString& path) const {
+    QString suffix = QFileInfo(path).suffix().toLower();
+    return suffix == "csv" || suffix == "txt" || suffix == "json";
+}
+
+void FolderSync::watchFiles() {
+    QDir dir(m_folder);
+    const QStringList watched = m_watcher->files();
+    for (const QFileInfo& info : dir.entryInfoList(QDir::Files)) {
+        QString path = info.absoluteFilePath();
+        if (isWordList(path) && !watched.contains(path)) {
+            m_watcher->addPath(path);
+        }
+    }
+}
+
+void FolderSync::onDirectoryChanged(const QString& path) {
+    Q_UNUSED(path);
+    const QStringList before = m_watcher->files();
+    watchFiles();
+    for (const QString& file : m_watcher->files()) {
+        if (!before.contains(file)) m_pending.insert(file);
+    }
+    m_debounce->start();
+}
+
+void FolderSync::onFileChanged(const QString& path) {
+    // Editors that save by rename drop the watch, so re-arm it.
+    if (QFileInfo::exists(path) && !m_watcher->files().contains(path)) {
+        m_watcher->addPath(path);
+    }
+    m_pending.insert(path);
+    m_debounce->start();
+}
+
+void FolderSync::flushPending() {
+    // One sync at a time; whatever changes meanwhile waits for the next.
+    if (m_syncing || m_pending.isEmpty()) return;
+
+    m_syncing = true;
+    const QStringList paths(m_pending.begin(), m_pending.end());
+    m_pending.clear();
+    const int generation = m_generation;
+    const QString connection = m_connection;
+    const QString folder = m_folder;
+    const QHash<QString, QByteArray> knownHashes = m_fileHashes;
+    QMetaObject::invokeMethod(m_worker, [this, generation, connection, folder, paths, knownHashes]() {
+        QList<SyncResult> results;
+        {
+            QSqlDatabase db = QSqlDatabase::cloneDatabase(QSqlDatabase::defaultConnection, connection);
+            db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=2000");
+            if (db.open()) {
+                // Only a file gone from a folder that is still there counts
+                // as deleted; an unmounted folder leaves its books alone.
+                const bool folderPresent = QFileInfo(folder).isDir();
+                for (const QString& path : paths) {
+                    if (m_stopping) break;
+                    if (QFileInfo::exists(path)) {
+                        results.append(syncFile(path, knownHashes.value(path), db));
+                    } else if (folderPresent) {
+                        SyncResult result;
+                        result.path = path;
+                        result.bookId = DatabaseManager::instance().detachSourceBook(QFileInfo(path).absoluteFilePath(), db);
+                        result.ok = true;
+                        result.detached = true;
+                        results.append(result);
+                    }
+                }
+                db.close();
+            } else {
+                qWarning() << "FolderSync: failed to open connection";
+            }
+        }
+        QSqlDatabase::removeDatabase(connection);
+
+        QMetaObject::invokeMethod(this, [this, generation, results]() {
+            finishSync(generation, results);
+        }, Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
+}
+
+void FolderSync::finishSync(int generation, const QList<SyncResult>& results) {
+    m_syncing = false;
+    for (const SyncResult& result : results) {
+        if (generation == m_generation) {
+            if (result.detached) {
+                m_fileHashes.remove(result.path);
+            } else if (result.ok) {
+                m_fileHashes.insert(result.path, result.fileHash);
+            }
+        }
+        // The books changed whichever folder is watched now.
+        if (result.inserted > 0 || result.updated > 0 || result.deleted > 0) {
+            emit bookSynced(result.bookId, result.inserted, result.updated, result.deleted);
+        }
+    }
+    if (!m_pending.isEmpty()) m_debounce->start();
+}
+
+qint64 FolderSync::recordHash(const Word& word) {
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    const QChar sep(0x1f);
+    hash.addData(QString(word.spelling + sep + word.phonetic + sep + word.definition + sep
+                         + word.example + sep + word.tags.join(";")).toUtf8());
+    return qFromLittleEndian<qint64>(hash.result().constData());
+}
+
+FolderSync::SyncResult FolderSync::syncFile(const QString& filePath, const QByteArray& knownHash,
+                                            const QSqlDatabase& db) {
+    SyncResult result;
+    result.path = filePath;
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) return result;
+    result.fileHash = QCryptographicHash::hash(file.readAll(), QCryptographicHash::Sha1);
+    file.close();
+    if (result.fileHash == knownHash) {
+        result.ok = true;
+        return result;
+    }
+
+    DatabaseManager& dm = DatabaseManager::instance();
+    QFileInfo info(filePath);
+    const int bookId = dm.getSourceBook(info.absoluteFilePath(), info.completeBaseName(), db);
+    if (bookId <= 0) {
+        qWarning() << "FolderSync: no book for" << filePath;
+        return result;
+    }
+    result.bookId = bookId;
+    // Rows with the same spelling and definition share one lexeme and so one
+    // membership; only the first copy takes part, or every later copy would
+    // count as inserted on each sync.
+    QList<Word> words;
+    QSet<QString> seen;
+    for (Word& w : DictionaryParser::parseFile(filePath)) {
+        const QString key = w.spelling + QChar(0x1f) + w.definition;
+        if (seen.contains(key)) continue;
+        seen.insert(key);
+        words.append(std::move(w));
+    }
+
+    QHash<QString, WordDigest> previous;
+    QHash<QString, int> occurrences;
+    for (const WordDigest& d : dm.getWordDigests(bookId, db)) {
+        previous.insert(d.spelling + QChar('\n') + QString::number(occurrences[d.spelling]++), d);
+    }
+    occurrences.clear();
+
+    QList<Word> inserted;
+    QList<Word> updated;
+    for (Word& w : words) {
+        w.bookId = bookId;
+        w.sourceHash = recordHash(w);
+        auto it = previous.find(w.spelling + QChar('\n') + QString::number(occurrences[w.spelling]++));
+        if (it == previous.end()) {
+            inserted.append(w);
+        } else {
+            if (it->sourceHash != w.sourceHash) {
+                w.id = it->id;
+                updated.append(w);
+            }
+            previous.erase(it);
+        }
+    }
+
+    QList<int> deleted;
+    for (const WordDigest& d : previous) deleted.append(d.id);
+
+    if (!inserted.isEmpty() || !updated.isEmpty() || !deleted.isEmpty()) {
+        if (!dm.applyWordDiff(bookId, inserted, updated, deleted, db)) {
+            qWarning() << "FolderSync: failed to sync" << filePath;
+            return result;
+        }
+    }
+    result.inserted = int(inserted.size());
+    result.updated = int(updated.size());
+    result.deleted = int(deleted.size());
+    result.ok = true;
+    return result;
+}
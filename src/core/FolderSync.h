@@ -0,0 +1,66 @@
+#pragma once
+#include "Word.h"
+#include <QObject>
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include <QSet>
+#include <QHash>
+#include <QSqlDatabase>
+#include <QThread>
+#include <atomic>
+
+// Keeps one book per word-list file in a watched folder. On change the file
+// is re-parsed, records are hashed and only the inserted, updated and
+// deleted rows are written back. Parsing and diffing run on a worker thread
+// with a connection of its own. A deleted file unlinks its book, which keeps
+// its words and progress.
+class FolderSync : public QObject {
+    Q_OBJECT
+
+public:
+    explicit FolderSync(QObject *parent = nullptr);
+    ~FolderSync();
+
+    void setFolder(const QString& path);
+    QString folder() const;
+
+    static qint64 recordHash(const Word& word);
+
+signals:
+    void bookSynced(int bookId, int inserted, int updated, int deleted);
+
+private slots:
+    void onDirectoryChanged(const QString& path);
+    void onFileChanged(const QString& path);
+    void flushPending();
+
+private:
+    struct SyncResult {
+        QString path;
+        QByteArray fileHash;
+        int bookId = 0;
+        int inserted = 0;
+        int updated = 0;
+        int deleted = 0;
+        bool ok = false;
+        bool detached = false;
+    };
+
+    bool isWordList(const QString& path) const;
+    void watchFiles();
+    void finishSync(int generation, const QList<SyncResult>& results);
+    static SyncResult syncFile(const QString& filePath, const QByteArray& knownHash, const QSqlDatabase& db);
+
+    QFileSystemWatcher *m_watcher;
+    QTimer *m_debounce;
+    QString m_folder;
+    QSet<QString> m_pending;
+    QHash<QString, QByteArray> m_fileHashes;
+
+    QThread m_thread;
+    QObject *m_worker;
+    QString m_connection;
+    int m_generation;
+    bool m_syncing;
+    std::atomic_bool m_stopping;
+};
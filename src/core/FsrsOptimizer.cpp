@@ -0,0 +1,290 @@
+#include "FsrsOptimizer.h"
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const int N = FsrsScheduler::WeightCount;
+
+// Value plus the partial derivatives with respect to every weight.
+struct Dual {
+    double v = 0.0;
+    double d[N] = {};
+
+    Dual() = default;
+    Dual(double x) : v(x) {}
+};
+
+inline Dual operator+(const Dual& a, const Dual& b) {
+    Dual r(a.v + b.v);
+    for (int i = 0; i < N; ++i) r.d[i] = a.d[i] + b.d[i];
+    return r;
+}
+
+inline Dual operator-(const Dual& a, const Dual& b) {
+    Dual r(a.v - b.v);
+    for (int i = 0; i < N; ++i) r.d[i] = a.d[i] - b.d[i];
+    return r;
+}
+
+inline Dual operator*(const Dual& a, const Dual& b) {
+    Dual r(a.v * b.v);
+    for (int i = 0; i < N; ++i) r.d[i] = a.d[i] * b.v + a.v * b.d[i];
+    return r;
+}
+
+inline Dual operator/(const Dual& a, const Dual& b) {
+    Dual r(a.v / b.v);
+    const double inv = 1.0 / (b.v * b.v);
+    for (int i = 0; i < N; ++i) r.d[i] = (a.d[i] * b.v - a.v * b.d[i]) * inv;
+    return r;
+}
+
+inline Dual scale(const Dual& a, double dv, double v) {
+    Dual r(v);
+    for (int i = 0; i < N; ++i) r.d[i] = a.d[i] * dv;
+    return r;
+}
+
+inline Dual exp(const Dual& a) {
+    double e = std::exp(a.v);
+    return scale(a, e, e);
+}
+
+inline Dual log(const Dual& a) {
+    return scale(a, 1.0 / a.v, std::log(a.v));
+}
+
+inline Dual pow(const Dual& a, const Dual& b) {
+    return exp(b * log(a));
+}
+
+inline double value(const Dual& a) { return a.v; }
+inline double value(double a) { return a; }
+
+template <typename T>
+inline T clampValue(const T& x, double lo, double hi) {
+    if (value(x) < lo) return T(lo);
+    if (value(x) > hi) return T(hi);
+    return x;
+}
+
+template <typename T>
+inline T minValue(const T& a, const T& b) {
+    return value(a) <= value(b) ? a : b;
+}
+
+// Replays one word's ratings through the same transitions as
+// FsrsScheduler::schedule() and accumulates the log-loss of every scored
+// review that had a predicted recall.
+template <typename T, typename Step>
+T sequenceLoss(const T *w, const Step *steps, int count, int& samples) {
+    using std::exp;
+    using std::log;
+    using std::pow;
+
+    T loss(0.0);
+    T s(0.0);
+    T d(0.0);
+    int state = 0;
+    for (int k = 0; k < count; ++k) {
+        const int r = steps[k].rating;
+        if (state == 0) {
+            s = value(w[r - 1]) < 0.1 ? T(0.1) : w[r - 1];
+            d = clampValue(w[4] - w[5] * T(r - 3), 1.0, 10.0);
+            state = r == 1 ? 1 : 2;
+        } else if (state == 1 || state == 3) {
+            if (r == 3) {
+                s = value(w[2]) < 0.1 ? T(0.1) : w[2];
+                d = clampValue(w[4], 1.0, 10.0);
+                state = 2;
+            }
+        } else {
+            const double t = steps[k].elapsedDays;
+            if (t > 0 && steps[k].scored) {
+                // FsrsScheduler::retrievability() on the dual type.
+                T p = T(1.0) / (T(1.0) + T(t) / (T(81.0) * s));
+                p = clampValue(p, 1e-6, 1.0 - 1e-6);
+                loss = loss - (r > 1 ? log(p) : log(T(1.0) - p));
+                ++samples;
+            }
+            T nextD = clampValue(w[7] * w[4] + (T(1.0) - w[7]) * (d - w[6] * T(r - 3)), 1.0, 10.0);
+            if (r == 1) {
+                s = minValue(s, w[11] * pow(d, T(0.0) - w[12]) * (pow(s + T(1.0), w[13]) - T(1.0)));
+                state = 3;
+            } else {
+                T factor = r == 2 ? (T(1.0) - w[10]) * w[11]
+                         : r == 3 ? w[10] * w[11]
+                                  : (T(1.0) + w[12]) * w[11];
+                s = s * (T(1.0) + exp(w[8]) * (T(11.0) - d) * pow(s, T(0.0) - w[9]) * (exp(factor) - T(1.0)));
+            }
+            d = nextD;
+        }
+    }
+    return loss;
+}
+
+// Keeps every weight inside the range where the model stays well defined.
+const double kLowerBound[N] = {0.1, 0.1, 0.1, 0.1, 1.0, 0.1, 0.1, 0.0, 0.0,
+                               0.1, 0.01, 0.5, 0.01, 0.01, 0.01, 0.0, 1.0};
+const double kUpperBound[N] = {100.0, 100.0, 100.0, 100.0, 10.0, 5.0, 5.0, 0.5, 3.0,
+                               0.8, 2.5, 5.0, 0.2, 0.9, 2.0, 1.0, 6.0};
+
+}
+
+FsrsOptimizer::FsrsOptimizer(const QList<double>& initialWeights)
+    : m_weights(initialWeights), m_initialLoss(0.0), m_finalLoss(0.0), m_samples(0) {
+    if (m_weights.size() != N) m_weights = FsrsScheduler::defaultWeights();
+}
+
+void FsrsOptimizer::setReviewLogs(const QList<ReviewLog>& logs) {
+    m_steps.clear();
+    m_sequenceStart.clear();
+    m_steps.reserve(logs.size());
+
+    int currentWord = -1;
+    QDateTime previous;
+    for (const ReviewLog& log : logs) {
+        if (log.rating < FsrsRating::Again || log.rating > FsrsRating::Easy) continue;
+        if (log.kind == ReviewKind::Check) continue;
+        if (log.wordId != currentWord) {
+            currentWord = log.wordId;
+            previous = QDateTime();
+            m_sequenceStart.push_back(int(m_steps.size()));
+        }
+        Step step;
+        step.rating = log.rating;
+        step.scored = log.kind == ReviewKind::Study;
+        step.elapsedDays = previous.isValid() && log.reviewedAt.isValid()
+            ? float(previous.msecsTo(log.reviewedAt) / 86400000.0) : 0.0f;
+        previous = log.reviewedAt;
+        m_steps.push_back(step);
+    }
+    m_sequenceStart.push_back(int(m_steps.size()));
+}
+
+FsrsOptimizer::Evaluation FsrsOptimizer::evaluate(const double *weights, bool withGradient) const {
+    const int sequences = int(m_sequenceStart.size()) - 1;
+    QThreadPool pool;
+    pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount()));
+    const int chunks = std::max(1, std::min(sequences, pool.maxThreadCount() * 4));
+    std::vector<Evaluation> partial(chunks);
+
+    for (int c = 0; c < chunks; ++c) {
+        pool.start([&, c]() {
+            Evaluation& out = partial[c];
+            const int first = int(qint64(sequences) * c / chunks);
+            const int last = int(qint64(sequences) * (c + 1) / chunks);
+            if (withGradient) {
+                Dual w[N];
+                for (int i = 0; i < N; ++i) {
+                    w[i].v = weights[i];
+                    w[i].d[i] = 1.0;
+                }
+                for (int q = first; q < last; ++q) {
+                    const int begin = m_sequenceStart[q];
+                    Dual loss = sequenceLoss(w, &m_steps[begin], m_sequenceStart[q + 1] - begin, out.samples);
+                    out.loss += loss.v;
+                    for (int i = 0; i < N; ++i) out.gradient[i] += loss.d[i];
+                }
+            } else {
+                for (int q = first; q < last; ++q) {
+                    const int begin = m_sequenceStart[q];
+                    out.loss += sequenceLoss(weights, &m_steps[begin], m_sequenceStart[q + 1] - begin, out.samples);
+                }
+            }
+        });
+    }
+    pool.waitForDone();
+
+    Evaluation total;
+    for (const Evaluation& e : partial) {
+        total.loss += e.loss;
+        total.samples += e.samples;
+        for (int i = 0; i < N; ++i) total.gradient[i] += e.gradient[i];
+    }
+    if (total.samples > 0) {
+        total.loss /= total.samples;
+        for (int i = 0; i < N; ++i) total.gradient[i] /= total.samples;
+    }
+    return total;
+}
+
+bool FsrsOptimizer::optimize(int iterations, double learningRate, const Progress& progress) {
+    m_error.clear();
+    if (m_sequenceStart.size() < 2) {
+        m_error = "no review history";
+        return false;
+    }
+
+    double w[N];
+    std::copy(m_weights.begin(), m_weights.end(), w);
+    Evaluation start = evaluate(w, false);
+    m_samples = start.samples;
+    m_initialLoss = m_finalLoss = start.loss;
+    if (m_samples < 100) {
+        m_error = "not enough reviews to fit weights";
+        return false;
+    }
+
+    // Adam on the mean log-loss, projected back into the bounds after each step.
+    const double beta1 = 0.9, beta2 = 0.999, epsilon = 1e-8;
+    double m[N] = {};
+    double v[N] = {};
+    double best[N];
+    std::copy(w, w + N, best);
+    double bestLoss = start.loss;
+
+    for (int step = 1; step <= iterations; ++step) {
+        if (progress && !progress(step - 1, iterations)) {
+            m_error = "cancelled";
+            return false;
+        }
+        Evaluation e = evaluate(w, true);
+        if (e.loss < bestLoss) {
+            bestLoss = e.loss;
+            std::copy(w, w + N, best);
+        }
+        const double correction1 = 1.0 - std::pow(beta1, step);
+        const double correction2 = 1.0 - std::pow(beta2, step);
+        for (int i = 0; i < N; ++i) {
+            const double g = e.gradient[i];
+            if (!std::isfinite(g)) continue;
+            m[i] = beta1 * m[i] + (1 - beta1) * g;
+            v[i] = beta2 * v[i] + (1 - beta2) * g * g;
+            w[i] -= learningRate * (m[i] / correction1) / (std::sqrt(v[i] / correction2) + epsilon);
+            w[i] = std::clamp(w[i], kLowerBound[i], kUpperBound[i]);
+        }
+    }
+
+    Evaluation last = evaluate(w, false);
+    if (last.loss < bestLoss) {
+        bestLoss = last.loss;
+        std::copy(w, w + N, best);
+    }
+    m_weights = QList<double>(best, best + N);
+    m_finalLoss = bestLoss;
+    return true;
+}
+
+QList<double> FsrsOptimizer::weights() const {
+    return m_weights;
+}
+
+double FsrsOptimizer::initialLoss() const {
+    return m_initialLoss;
+}
+
+double FsrsOptimizer::finalLoss() const {
+    return m_finalLoss;
+}
+
+int FsrsOptimizer::sampleCount() const {
+    return m_samples;
+}
+
+QString FsrsOptimizer::errorString() const {
+    return m_error;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "FsrsScheduler.h"
+#include <QList>
+#include <QString>
+#include <functional>
+#include <vector>
+
+// Fits FsrsScheduler weights to a review history by minimising the log-loss
+// of predicted recall. Sequences are the per-word review logs; gradients are
+// exact (forward-mode) and summed across cores each step.
+//
+// The replay uses FsrsScheduler's transitions, which ignore elapsed time: a
+// review's new stability depends on the old stability, difficulty and rating,
+// not on the retrievability at the moment of review. Elapsed time only enters
+// through the predicted recall being scored, so weights fitted here suit this
+// scheduler and are not interchangeable with those of the full FSRS model.
+class FsrsOptimizer {
+public:
+    // Called once per step with (steps done, total steps); return false to
+    // cancel. Runs on the thread that called optimize().
+    using Progress = std::function<bool(int done, int total)>;
+
+    explicit FsrsOptimizer(const QList<double>& initialWeights = FsrsScheduler::defaultWeights());
+
+    // logs must be ordered by word and review time, as getReviewLogs() returns them.
+    // Test answers move the memory state like any review but are not scored:
+    // a multiple-choice pick says little about free recall. Checks did not
+    // move the card and are dropped.
+    void setReviewLogs(const QList<ReviewLog>& logs);
+
+    // On failure or cancellation the weights are left as they were.
+    bool optimize(int iterations = 100, double learningRate = 0.04, const Progress& progress = Progress());
+
+    QList<double> weights() const;
+    double initialLoss() const;
+    double finalLoss() const;
+    int sampleCount() const;
+    QString errorString() const;
+
+private:
+    struct Step {
+        float elapsedDays;
+        int rating;
+        bool scored;
+    };
+
+    struct Evaluation {
+        double loss = 0.0;
+        double gradient[FsrsScheduler::WeightCount] = {};
+        int samples = 0;
+    };
+
+    Evaluation evaluate(const double *weights, bool withGradient) const;
+
+    std::vector<Step> m_steps;
+    std::vector<int> m_sequenceStart;
+    QList<double> m_weights;
+    double m_initialLoss;
+    double m_finalLoss;
+    int m_samples;
+    QString m_error;
+};
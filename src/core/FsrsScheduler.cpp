@@ -1,7 +1,193 @@
 #include "FsrsScheduler.h"
+#include <QSettings>
+#include <QVariant>
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+static const double kDefaultWeights[FsrsScheduler::WeightCount] = {
+    0.4, 0.6, 2.4, 5.8, 4.93, 0.94, 0.86, 0.01, 1.49, 0.14, 0.94,
+    2.18, 0.05, 0.34, 1.26, 0.29, 2.61
+};
+
+namespace {
+
+// Branch-free log/exp for the batch kernel. The libm calls are opaque to the
+// auto-vectorizer; these are plain arithmetic and integer bit moves, so a
+// loop over them compiles to SIMD. Both stay within a few ulp of libm over
+// the range the scheduler uses (finite, positive arguments).
+
+inline std::uint64_t bitsOf(double x) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &x, sizeof bits);
+    return bits;
+}
+
+inline double fromBits(std::uint64_t bits) {
+    double x;
+    std::memcpy(&x, &bits, sizeof x);
+    return x;
+}
+
+const double kLn2Hi = 6.93147180369123816490e-01;
+const double kLn2Lo = 1.90821492927058770002e-10;
+
+// x = 2^k * m with m in [sqrt(1/2), sqrt(2)); ln m = 2 atanh(f), f = (m-1)/(m+1).
+inline double logPositive(double x) {
+    const std::uint64_t offset = 0x3fe6a09e667f3bcdULL; // bits of sqrt(1/2)
+    const std::uint64_t t = bitsOf(x) - offset;
+    // k as a double without an int64 conversion, which SSE2/AVX2 lack.
+    const std::uint64_t biased = (t + (std::uint64_t(1) << 63)) >> 52;
+    const double k = fromBits(0x4330000000000000ULL | biased) - (4503599627370496.0 + 2048.0);
+    const double m = fromBits(bitsOf(x) - ((t >> 52) << 52));
+    const double f = (m - 1.0) / (m + 1.0);
+    const double f2 = f * f;
+    double p = 1.0 / 19;
+    p = p * f2 + 1.0 / 17;
+    p = p * f2 + 1.0 / 15;
+    p = p * f2 + 1.0 / 13;
+    p = p * f2 + 1.0 / 11;
+    p = p * f2 + 1.0 / 9;
+    p = p * f2 + 1.0 / 7;
+    p = p * f2 + 1.0 / 5;
+    p = p * f2 + 1.0 / 3;
+    p = p * f2 + 1.0;
+    return k * kLn2Hi + (2.0 * f * p + k * kLn2Lo);
+}
+
+// x = k ln2 + r with |r| <= ln2 / 2; 2^k is added straight into the exponent.
+inline double expFinite(double x) {
+    const double shift = 6755399441055744.0; // 1.5 * 2^52
+    const double kd = x * 1.4426950408889634 + shift;
+    const std::uint64_t ki = bitsOf(kd);
+    const double k = kd - shift;
+    const double r = (x - k * kLn2Hi) - k * kLn2Lo;
+    double p = 1.0 / 479001600;
+    p = p * r + 1.0 / 39916800;
+    p = p * r + 1.0 / 3628800;
+    p = p * r + 1.0 / 362880;
+    p = p * r + 1.0 / 40320;
+    p = p * r + 1.0 / 5040;
+    p = p * r + 1.0 / 720;
+    p = p * r + 1.0 / 120;
+    p = p * r + 1.0 / 24;
+    p = p * r + 1.0 / 6;
+    p = p * r + 0.5;
+    p = p * r + 1.0;
+    p = p * r + 1.0;
+    return fromBits(bitsOf(p) + (ki << 52));
+}
+
+inline double powPositive(double x, double y) {
+    return expFinite(y * logPositive(x));
+}
+
+}
 
 FsrsScheduler::FsrsScheduler() {
+    std::copy(std::begin(kDefaultWeights), std::end(kDefaultWeights), w);
+    QString profile = currentProfile();
+    m_desiredRetention = storedRetention(profile);
+    m_loadBalancing = QSettings("AutoWord", "Config").value("Fsrs/LoadBalancing", false).toBool();
+    setWeights(storedWeights(profile));
+}
+
+double FsrsScheduler::desiredRetention() const {
+    return m_desiredRetention;
+}
+
+void FsrsScheduler::setDesiredRetention(double retention) {
+    m_desiredRetention = std::clamp(retention, 0.7, 0.99);
+    updateConstants();
+}
+
+bool FsrsScheduler::loadBalancing() const {
+    return m_loadBalancing;
+}
+
+void FsrsScheduler::setLoadBalancing(bool enabled) {
+    m_loadBalancing = enabled;
+}
+
+void FsrsScheduler::setDayLoad(DayLoad dayLoad) {
+    m_dayLoad = std::move(dayLoad);
+}
+
+double FsrsScheduler::retrievability(double elapsedDays, double stability) {
+    return 1.0 / (1.0 + elapsedDays / (81.0 * stability));
+}
+
+QList<double> FsrsScheduler::weights() const {
+    return QList<double>(std::begin(w), std::end(w));
+}
+
+void FsrsScheduler::setWeights(const QList<double>& weights) {
+    if (weights.size() == WeightCount) {
+        std::copy(weights.begin(), weights.end(), w);
+    }
+    updateConstants();
+}
+
+QList<double> FsrsScheduler::defaultWeights() {
+    return QList<double>(std::begin(kDefaultWeights), std::end(kDefaultWeights));
+}
+
+QString FsrsScheduler::currentProfile() {
+    QSettings settings("AutoWord", "Config");
+    return settings.value("Fsrs/Profile", "default").toString();
+}
+
+QList<double> FsrsScheduler::storedWeights(const QString& profile) {
+    QSettings settings("AutoWord", "Config");
+    QList<double> weights;
+    for (const QVariant& v : settings.value(QString("Fsrs/%1/Weights").arg(profile)).toList()) {
+        bool ok = false;
+        double value = v.toDouble(&ok);
+        if (!ok || !std::isfinite(value)) return {};
+        weights.append(value);
+    }
+    if (weights.size() != WeightCount) return {};
+    return weights;
+}
+
+double FsrsScheduler::storedRetention(const QString& profile) {
+    QSettings settings("AutoWord", "Config");
+    double retention = settings.value(QString("Fsrs/%1/DesiredRetention").arg(profile), 0.9).toDouble();
+    return std::clamp(retention, 0.7, 0.99);
+}
+
+void FsrsScheduler::storeRetention(const QString& profile, double retention) {
+    QSettings settings("AutoWord", "Config");
+    settings.setValue(QString("Fsrs/%1/DesiredRetention").arg(profile), retention);
+}
+
+void FsrsScheduler::storeWeights(const QString& profile, const QList<double>& weights) {
+    QSettings settings("AutoWord", "Config");
+    QVariantList list;
+    for (double value : weights) list.append(value);
+    settings.setValue(QString("Fsrs/%1/Weights").arg(profile), list);
+}
+
+void FsrsScheduler::updateConstants() {
+    // Each term is computed exactly as the scalar helpers compute it, so the
+    // batch kernel differs from schedule() only in its powers.
+    for (int rating = FsrsRating::Again; rating <= FsrsRating::Easy; ++rating) {
+        m_initStability[rating] = init_stability(rating);
+        m_initDifficulty[rating] = init_difficulty(rating);
+        m_difficultyDelta[rating] = w[6] * (rating - 3);
+    }
+    m_initStability[0] = m_initDifficulty[0] = m_difficultyDelta[0] = 0.0;
+    m_recallFactor[0] = m_recallFactor[FsrsRating::Again] = 0.0;
+    m_recallFactor[FsrsRating::Hard] = std::exp((1 - w[10]) * w[11]) - 1;
+    m_recallFactor[FsrsRating::Good] = std::exp(w[10] * w[11]) - 1;
+    m_recallFactor[FsrsRating::Easy] = std::exp((1 + w[12]) * w[11]) - 1;
+    m_expW8 = std::exp(w[8]);
+    m_meanReversion = w[7] * w[4];
+    m_keepDifficulty = 1 - w[7];
+    m_forgetFactor = std::exp(w[14] * (1 - FsrsRating::Again));
+    // The curve is linear in S, so the whole inversion folds into one factor
+    // (9 at the default 90% retention).
+    m_intervalFactor = 81.0 * (1.0 / m_desiredRetention - 1.0);
 }
 
 double FsrsScheduler::init_stability(int rating) {
@@ -32,11 +218,42 @@ double FsrsScheduler::next_forget_stability(double s, double d, int rating) {
 }
 
 int FsrsScheduler::next_interval(double s) {
-    int new_interval = std::round(s * 9); 
-    return std::max(1, new_interval);
+    return intervalFor(s);
+}
+
+int FsrsScheduler::intervalFor(double stability) const {
+    // Clamped as a double: fitted weights or imported cards can carry
+    // stabilities far beyond what fits an int. NaN falls to the minimum.
+    const double days = std::round(stability * m_intervalFactor);
+    if (!(days >= 1.0)) return 1;
+    return int(std::min(days, double(MaxInterval)));
+}
+
+int FsrsScheduler::balance_interval(int interval, const QDate& today) const {
+    if (!m_loadBalancing || !m_dayLoad || interval < 3) return interval;
+
+    // Fuzz ranges narrow as intervals grow, so long intervals barely move.
+    double fuzz = interval < 7 ? 0.15 : interval < 20 ? 0.1 : 0.05;
+    int delta = std::max(1, int(std::round(interval * fuzz)));
+    int lo = std::max(1, interval - delta);
+    int hi = std::min(MaxInterval, interval + delta);
+
+    int best = interval;
+    int bestLoad = m_dayLoad(today.addDays(interval));
+    for (int days = lo; days <= hi; ++days) {
+        if (days == interval) continue;
+        int load = m_dayLoad(today.addDays(days));
+        if (load < bestLoad || (load == bestLoad && std::abs(days - interval) < std::abs(best - interval))) {
+            best = days;
+            bestLoad = load;
+        }
+    }
+    return best;
 }
 
 FsrsCard FsrsScheduler::schedule(FsrsCard card, FsrsRating::Rating rating, QDateTime now) {
+    if (rating < FsrsRating::Again || rating > FsrsRating::Easy) return card;
+
     FsrsCard newCard = card;
     newCard.lastReview = now;
     newCard.reps += 1;
@@ -56,7 +273,7 @@ FsrsCard FsrsScheduler::schedule(FsrsCard card, FsrsRating::Rating rating, QDate
              newCard.scheduledDays = 0;
              newCard.due = now.addSecs(600); 
         } else { 
-             newCard.scheduledDays = next_interval(newCard.stability);
+             newCard.scheduledDays = balance_interval(next_interval(newCard.stability), now.date());
              newCard.due = now.addDays(newCard.scheduledDays);
              newCard.state = 2; 
         }
@@ -64,11 +281,17 @@ FsrsCard FsrsScheduler::schedule(FsrsCard card, FsrsRating::Rating rating, QDate
         if (rating == FsrsRating::Again) {
             newCard.scheduledDays = 0;
             newCard.due = now.addSecs(60);
-        } else if (rating == FsrsRating::Good) {
+        } else if (rating == FsrsRating::Hard) {
+            // Repeat the step a little later rather than leaving the old,
+            // already past due in place.
+            newCard.scheduledDays = 0;
+            newCard.due = now.addSecs(300);
+        } else {
+            // Good and Easy graduate the card.
             newCard.state = 2; 
-            newCard.stability = init_stability(FsrsRating::Good); 
-            newCard.difficulty = init_difficulty(FsrsRating::Good);
-            newCard.scheduledDays = next_interval(newCard.stability);
+            newCard.stability = init_stability(rating); 
+            newCard.difficulty = init_difficulty(rating);
+            newCard.scheduledDays = balance_interval(next_interval(newCard.stability), now.date());
             newCard.due = now.addDays(newCard.scheduledDays);
         }
     } else { 
@@ -82,10 +305,175 @@ FsrsCard FsrsScheduler::schedule(FsrsCard card, FsrsRating::Rating rating, QDate
         } else {
             newCard.stability = next_stability(card.stability, card.difficulty, rating);
             newCard.difficulty = next_difficulty(card.difficulty, rating);
-            newCard.scheduledDays = next_interval(newCard.stability);
+            newCard.scheduledDays = balance_interval(next_interval(newCard.stability), now.date());
             newCard.due = now.addDays(newCard.scheduledDays);
         }
     }
 
     return newCard;
 }
+
+FsrsPreview FsrsScheduler::previewAll(const FsrsCard& card, const QDateTime& now) {
+    FsrsPreview preview;
+    if (card.state != 2) {
+        // New and learning transitions are table lookups; nothing to share.
+        for (int rating = FsrsRating::Again; rating <= FsrsRating::Easy; ++rating) {
+            preview.outcomes[rating - 1] = schedule(card, static_cast<FsrsRating::Rating>(rating), now);
+        }
+        return preview;
+    }
+
+    const double s = card.stability;
+    const double d = card.difficulty;
+    const double growth = m_expW8 * (11 - d) * std::pow(s, -w[9]);
+    const double keep = m_keepDifficulty;
+    const QDate today = now.date();
+
+    for (int rating = FsrsRating::Again; rating <= FsrsRating::Easy; ++rating) {
+        FsrsCard& out = preview.outcomes[rating - 1];
+        out = card;
+        out.lastReview = now;
+        out.reps += 1;
+        out.difficulty = std::min(10.0, std::max(1.0, m_meanReversion + keep * (d - m_difficultyDelta[rating])));
+        if (rating == FsrsRating::Again) {
+            out.lapses += 1;
+            out.state = 3;
+            out.stability = next_forget_stability(s, d, rating);
+            out.scheduledDays = 0;
+            out.due = now.addSecs(60);
+        } else {
+            out.stability = s * (1 + growth * m_recallFactor[rating]);
+            out.scheduledDays = balance_interval(intervalFor(out.stability), today);
+            out.due = now.addDays(out.scheduledDays);
+        }
+    }
+    return preview;
+}
+
+void FsrsCardBatch::resize(qsizetype n) {
+    stability.resize(n);
+    difficulty.resize(n);
+    state.resize(n);
+    elapsedDays.resize(n);
+    scheduledDays.resize(n);
+    reps.resize(n);
+    lapses.resize(n);
+    dueSecs.resize(n);
+}
+
+FsrsCardBatch FsrsCardBatch::fromCards(const QList<FsrsCard>& cards) {
+    FsrsCardBatch batch;
+    batch.resize(cards.size());
+    for (qsizetype i = 0; i < cards.size(); ++i) {
+        const FsrsCard& c = cards[i];
+        batch.stability[i] = c.stability;
+        batch.difficulty[i] = c.difficulty;
+        batch.state[i] = c.state;
+        batch.elapsedDays[i] = c.elapsedDays;
+        batch.scheduledDays[i] = c.scheduledDays;
+        batch.reps[i] = c.reps;
+        batch.lapses[i] = c.lapses;
+        batch.dueSecs[i] = -1;
+    }
+    return batch;
+}
+
+void FsrsCardBatch::applyTo(QList<FsrsCard>& cards, const QDateTime& now) const {
+    for (qsizetype i = 0; i < cards.size() && i < size(); ++i) {
+        FsrsCard& c = cards[i];
+        c.stability = stability[i];
+        c.difficulty = difficulty[i];
+        c.state = state[i];
+        c.elapsedDays = elapsedDays[i];
+        c.scheduledDays = scheduledDays[i];
+        c.reps = reps[i];
+        c.lapses = lapses[i];
+        c.lastReview = now;
+        if (dueSecs[i] > 0) {
+            c.due = now.addSecs(dueSecs[i]);
+        } else if (dueSecs[i] == 0) {
+            c.due = now.addDays(scheduledDays[i]);
+        }
+    }
+}
+
+void FsrsScheduler::scheduleBatch(FsrsCardBatch& batch, const QList<int>& ratings) const {
+    const qsizetype n = std::min(batch.size(), ratings.size());
+    double *stability = batch.stability.data();
+    double *difficulty = batch.difficulty.data();
+    int *state = batch.state.data();
+    int *scheduled = batch.scheduledDays.data();
+    int *reps = batch.reps.data();
+    int *lapses = batch.lapses.data();
+    int *dueSecs = batch.dueSecs.data();
+    const int *rating = ratings.constData();
+
+    // Locals, so the compiler can see the kernel's stores never alias them.
+    const double w6 = w[6], w9 = w[9], w11 = w[11], w12 = w[12], w13 = w[13];
+    const double expW8 = m_expW8, meanReversion = m_meanReversion, keep = m_keepDifficulty;
+    const double forgetFactor = m_forgetFactor;
+    const double hard = m_recallFactor[FsrsRating::Hard];
+    const double good = m_recallFactor[FsrsRating::Good];
+    const double easy = m_recallFactor[FsrsRating::Easy];
+    static const int learningStep[5] = {0, 60, 300, 600, 0};
+
+    constexpr qsizetype Block = 256;
+    double recallS[Block];
+    double forgetS[Block];
+    double nextD[Block];
+
+    for (qsizetype base = 0; base < n; base += Block) {
+        const qsizetype m = std::min(Block, n - base);
+        const double *s = stability + base;
+        const double *d = difficulty + base;
+        const int *r = rating + base;
+
+        // The review transition for every lane of the block, with selects in
+        // place of branches and table lookups; this loop vectorizes. Results
+        // for lanes that are not in review are computed and thrown away.
+        for (qsizetype j = 0; j < m; ++j) {
+            const double factor = r[j] == FsrsRating::Hard ? hard
+                                : r[j] == FsrsRating::Good ? good
+                                : r[j] == FsrsRating::Easy ? easy : 0.0;
+            nextD[j] = std::min(10.0, std::max(1.0, meanReversion + keep * (d[j] - w6 * (r[j] - 3))));
+            recallS[j] = s[j] * (1 + expW8 * (11 - d[j]) * powPositive(s[j], -w9) * factor);
+            forgetS[j] = std::min(s[j], w11 * powPositive(d[j], -w12) * (powPositive(s[j] + 1, w13) - 1) * forgetFactor);
+        }
+
+        for (qsizetype j = 0; j < m; ++j) {
+            const qsizetype i = base + j;
+            const int ri = r[j];
+            if (ri < FsrsRating::Again || ri > FsrsRating::Easy) {
+                // Not a rating; the lane is left as it was.
+                dueSecs[i] = -1;
+                continue;
+            }
+            reps[i] += 1;
+
+            if (state[i] == 2) {
+                const bool again = ri == FsrsRating::Again;
+                stability[i] = again ? forgetS[j] : recallS[j];
+                difficulty[i] = nextD[j];
+                state[i] = again ? 3 : 2;
+                lapses[i] += again;
+                scheduled[i] = again ? 0 : intervalFor(stability[i]);
+                dueSecs[i] = again ? 60 : 0;
+            } else if (state[i] == 0) {
+                stability[i] = m_initStability[ri];
+                difficulty[i] = m_initDifficulty[ri];
+                state[i] = ri == FsrsRating::Again ? 1 : 2;
+                scheduled[i] = ri == FsrsRating::Easy ? intervalFor(stability[i]) : 0;
+                dueSecs[i] = learningStep[ri];
+            } else if (ri == FsrsRating::Again || ri == FsrsRating::Hard) {
+                scheduled[i] = 0;
+                dueSecs[i] = learningStep[ri];
+            } else {
+                state[i] = 2;
+                stability[i] = m_initStability[ri];
+                difficulty[i] = m_initDifficulty[ri];
+                scheduled[i] = intervalFor(stability[i]);
+                dueSecs[i] = 0;
+            }
+        }
+    }
+}
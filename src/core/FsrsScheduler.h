@@ -1,6 +1,8 @@
 #pragma once
 #include <QDateTime>
+#include <QList>
 #include <cmath>
+#include <functional>
 
 struct FsrsCard {
     int id = -1;
@@ -16,6 +18,30 @@ struct FsrsCard {
     QDateTime lastReview;
 };
 
+// Where a rating came from: a study session or a test answer. Check is a
+// test answer on a card that was not due; it is logged but did not change
+// the card.
+struct ReviewKind {
+    enum Kind {
+        Study = 0,
+        Test = 1,
+        Check = 2
+    };
+};
+
+// One rating event, as written to the review_logs table. state is the card
+// state before the rating.
+struct ReviewLog {
+    qint64 id = -1;
+    int wordId = -1;
+    int rating = 0;
+    int state = 0;
+    int elapsedDays = 0;
+    int scheduledDays = 0;
+    int kind = ReviewKind::Study;
+    QDateTime reviewedAt;
+};
+
 struct FsrsRating {
     enum Rating {
         Again = 1,
@@ -25,17 +51,102 @@ struct FsrsRating {
     };
 };
 
+// The four possible outcomes of rating one card, indexed by rating.
+struct FsrsPreview {
+    FsrsCard outcomes[4];
+
+    const FsrsCard& operator[](FsrsRating::Rating rating) const { return outcomes[rating - 1]; }
+};
+
+// Cards in structure-of-arrays form for FsrsScheduler::scheduleBatch, one
+// lane per card. dueSecs is written by the kernel: > 0 is a learning step in
+// seconds from the review, 0 means due after scheduledDays, -1 keeps the old
+// due (the rating was not 1..4 and the lane was left as it was).
+struct FsrsCardBatch {
+    QList<double> stability;
+    QList<double> difficulty;
+    QList<int> state;
+    QList<int> elapsedDays;
+    QList<int> scheduledDays;
+    QList<int> reps;
+    QList<int> lapses;
+    QList<int> dueSecs;
+
+    qsizetype size() const { return state.size(); }
+    void resize(qsizetype n);
+
+    static FsrsCardBatch fromCards(const QList<FsrsCard>& cards);
+    void applyTo(QList<FsrsCard>& cards, const QDateTime& now) const;
+};
+
 class FsrsScheduler {
 public:
+    static constexpr int WeightCount = 17;
+    static constexpr int MaxInterval = 36500;
+
+    // Loads the weights stored for the current profile, or the defaults.
     FsrsScheduler();
+
+    QList<double> weights() const;
+    void setWeights(const QList<double>& weights);
+
+    // Target probability of recall when a review comes due. Intervals follow
+    // from inverting the forgetting curve R(t) = (1 + t / (81 S))^-1.
+    double desiredRetention() const;
+    void setDesiredRetention(double retention);
+    static double retrievability(double elapsedDays, double stability);
+    int intervalFor(double stability) const;
+
+    // Number of cards already due on a date, e.g. DueIndex::dueOn().
+    using DayLoad = std::function<int(const QDate&)>;
+
+    // When enabled, schedule() moves each review interval to the least-loaded
+    // day within a fuzz window around the ideal one. scheduleBatch() is
+    // never balanced.
+    bool loadBalancing() const;
+    void setLoadBalancing(bool enabled);
+    void setDayLoad(DayLoad dayLoad);
+
+    static QList<double> defaultWeights();
+    static QString currentProfile();
+    static QList<double> storedWeights(const QString& profile);
+    static void storeWeights(const QString& profile, const QList<double>& weights);
+    static double storedRetention(const QString& profile);
+    static void storeRetention(const QString& profile, double retention);
     
     FsrsCard schedule(FsrsCard card, FsrsRating::Rating rating, QDateTime now = QDateTime::currentDateTime());
 
+    // All four outcomes of schedule() for one card. Review cards share the
+    // stability power and difficulty terms across ratings; each outcome is
+    // identical to the matching schedule() call.
+    FsrsPreview previewAll(const FsrsCard& card, const QDateTime& now = QDateTime::currentDateTime());
+
+    // Same transitions as schedule() for every lane, with one rating per card;
+    // lanes rated outside 1..4 are left untouched. The review transition runs
+    // as a branch-free loop over blocks of lanes that the compiler vectorizes,
+    // with its own pow, so stability can differ from schedule() by a few ulp
+    // and an interval by a day where it rounds at exactly .5.
+    // bench/FsrsBatchBench checks this against schedule() and times both.
+    void scheduleBatch(FsrsCardBatch& batch, const QList<int>& ratings) const;
+
 private:
-    double w[17] = {
-        0.4, 0.6, 2.4, 5.8, 4.93, 0.94, 0.86, 0.01, 1.49, 0.14, 0.94, 
-        2.18, 0.05, 0.34, 1.26, 0.29, 2.61
-    };
+    double w[WeightCount];
+    double m_desiredRetention = 0.9;
+    bool m_loadBalancing = false;
+    DayLoad m_dayLoad;
+
+    // Weight-derived terms hoisted out of the per-card path, indexed by rating.
+    double m_initStability[5];
+    double m_initDifficulty[5];
+    double m_difficultyDelta[5];
+    double m_recallFactor[5];
+    double m_expW8;
+    double m_meanReversion;
+    double m_keepDifficulty;
+    double m_forgetFactor;
+    double m_intervalFactor;
+
+    void updateConstants();
 
     double init_stability(int rating);
     double init_difficulty(int rating);
@@ -43,4 +154,5 @@ private:
     double next_stability(double s, double d, int rating);
     double next_forget_stability(double s, double d, int rating);
     int next_interval(double s);
+    int balance_interval(int interval, const QDate& today) const;
 };
@@ -0,0 +1,571 @@
+#include "MdxParser.h"
+#include "DictionaryParser.h"
+#include <QThreadPool>
+#include <QThread>
+#include <QHash>
+#include <QRegularExpression>
+#include <QStringDecoder>
+#include <QDateTime>
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+quint32 rol(quint32 x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+void ripemd128(const uchar *data, size_t len, uchar out[16]) {
+    static const int R[64] = {
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+        7, 4, 13, 1, 10, 6, 15, 3, 12, 0, 9, 5, 2, 14, 11, 8,
+        3, 10, 14, 4, 9, 15, 8, 1, 2, 7, 0, 6, 13, 11, 5, 12,
+        1, 9, 11, 10, 0, 8, 12, 4, 13, 3, 7, 15, 14, 5, 6, 2
+    };
+    static const int RP[64] = {
+        5, 14, 7, 0, 9, 2, 11, 4, 13, 6, 15, 8, 1, 10, 3, 12,
+        6, 11, 3, 7, 0, 13, 5, 10, 14, 15, 8, 12, 4, 9, 1, 2,
+        15, 5, 1, 3, 7, 14, 6, 9, 11, 8, 12, 2, 10, 0, 4, 13,
+        8, 6, 4, 1, 3, 11, 15, 0, 5, 12, 2, 13, 9, 7, 10, 14
+    };
+    static const int S[64] = {
+        11, 14, 15, 12, 5, 8, 7, 9, 11, 13, 14, 15, 6, 7, 9, 8,
+        7, 6, 8, 13, 11, 9, 7, 15, 7, 12, 15, 9, 11, 7, 13, 12,
+        11, 13, 6, 7, 14, 9, 13, 15, 14, 8, 13, 6, 5, 12, 7, 5,
+        11, 12, 14, 15, 14, 15, 9, 8, 9, 14, 5, 6, 8, 6, 5, 12
+    };
+    static const int SP[64] = {
+        8, 9, 9, 11, 13, 15, 15, 5, 7, 7, 8, 11, 14, 14, 12, 6,
+        9, 13, 15, 7, 12, 8, 9, 11, 7, 7, 12, 7, 6, 15, 13, 11,
+        9, 7, 15, 11, 8, 6, 6, 14, 12, 13, 5, 14, 13, 13, 7, 5,
+        15, 5, 8, 11, 14, 14, 6, 14, 6, 9, 12, 9, 12, 5, 15, 8
+    };
+    static const quint32 K[4] = {0x00000000, 0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC};
+    static const quint32 KP[4] = {0x50A28BE6, 0x5C4DD124, 0x6D703EF3, 0x00000000};
+
+    auto f = [](int j, quint32 x, quint32 y, quint32 z) -> quint32 {
+        switch (j) {
+        case 0: return x ^ y ^ z;
+        case 1: return (x & y) | (~x & z);
+        case 2: return (x | ~y) ^ z;
+        default: return (x & z) | (y & ~z);
+        }
+    };
+
+    QByteArray msg(reinterpret_cast<const char*>(data), qsizetype(len));
+    msg.append(char(0x80));
+    while (msg.size() % 64 != 56) msg.append('\0');
+    quint64 bits = quint64(len) * 8;
+    for (int i = 0; i < 8; ++i) msg.append(char(bits >> (8 * i)));
+
+    quint32 h[4] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476};
+    const uchar *m = reinterpret_cast<const uchar*>(msg.constData());
+    for (qsizetype off = 0; off < msg.size(); off += 64) {
+        quint32 x[16];
+        for (int i = 0; i < 16; ++i) x[i] = qFromLittleEndian<quint32>(m + off + i * 4);
+
+        quint32 a = h[0], b = h[1], c = h[2], d = h[3];
+        quint32 ap = h[0], bp = h[1], cp = h[2], dp = h[3];
+        for (int j = 0; j < 64; ++j) {
+            int round = j / 16;
+            quint32 t = rol(a + f(round, b, c, d) + x[R[j]] + K[round], S[j]);
+            a = d; d = c; c = b; b = t;
+            t = rol(ap + f(3 - round, bp, cp, dp) + x[RP[j]] + KP[round], SP[j]);
+            ap = dp; dp = cp; cp = bp; bp = t;
+        }
+        quint32 t = h[1] + c + dp;
+        h[1] = h[2] + d + ap;
+        h[2] = h[3] + a + bp;
+        h[3] = h[0] + b + cp;
+        h[0] = t;
+    }
+    for (int i = 0; i < 4; ++i) qToLittleEndian(h[i], out + i * 4);
+}
+
+// Key block info of engine 2.0 files with Encrypted="2" is scrambled with a
+// key derived from the block's own checksum.
+QByteArray decryptKeyBlockInfo(const QByteArray& block) {
+    if (block.size() < 8) return block;
+    uchar seed[8];
+    std::memcpy(seed, block.constData() + 4, 4);
+    qToLittleEndian<quint32>(0x3695, seed + 4);
+    uchar key[16];
+    ripemd128(seed, sizeof(seed), key);
+
+    QByteArray out = block;
+    uchar *p = reinterpret_cast<uchar*>(out.data());
+    uchar previous = 0x36;
+    for (qsizetype i = 8; i < out.size(); ++i) {
+        uchar b = p[i];
+        uchar t = uchar((b >> 4) | (b << 4));
+        t = t ^ previous ^ uchar((i - 8) & 0xFF) ^ key[(i - 8) % 16];
+        previous = b;
+        p[i] = t;
+    }
+    return out;
+}
+
+// Reads an LZO run length: each zero byte adds 255, the first non-zero byte
+// ends the run. Returns -1 when the input ends first.
+qsizetype lzoRunLength(const uchar *&ip, const uchar *end, qsizetype base) {
+    qsizetype zeros = 0;
+    while (ip < end && *ip == 0) {
+        ++ip;
+        if (++zeros > (1 << 24)) return -1;
+    }
+    if (ip >= end) return -1;
+    return base + zeros * 255 + *ip++;
+}
+
+// LZO1X decompression (block type 1), following lzo1x_decompress_safe: every
+// copy is checked against both buffers, so a corrupt block fails instead of
+// reading or writing out of bounds. Returns the decompressed size, or -1.
+qsizetype lzo1xDecompress(const uchar *in, qsizetype inSize, uchar *out, qsizetype outSize) {
+    const uchar *ip = in;
+    const uchar *const ipEnd = in + inSize;
+    uchar *op = out;
+    uchar *const opEnd = out + outSize;
+
+    auto copyLiterals = [&](qsizetype count) {
+        if (ipEnd - ip < count || opEnd - op < count) return false;
+        std::memcpy(op, ip, size_t(count));
+        ip += count;
+        op += count;
+        return true;
+    };
+
+    // state: literals copied by the last instruction (0..3), or 4 after a
+    // long literal run. It selects what opcodes 0..15 mean.
+    int state = 0;
+    if (ip < ipEnd && *ip > 17) {
+        qsizetype t = *ip++ - 17;
+        if (!copyLiterals(t)) return -1;
+        state = t < 4 ? int(t) : 4;
+    }
+
+    for (;;) {
+        if (ip >= ipEnd) return -1;
+        qsizetype t = *ip++;
+        qsizetype distance = 0;
+        qsizetype length = 0;
+        int next = 0;
+
+        if (t < 16) {
+            if (state == 0) {
+                length = t == 0 ? lzoRunLength(ip, ipEnd, 15) : t;
+                if (length < 0 || !copyLiterals(length + 3)) return -1;
+                state = 4;
+                continue;
+            }
+            if (ip >= ipEnd) return -1;
+            next = int(t & 3);
+            distance = 1 + (t >> 2) + (qsizetype(*ip++) << 2);
+            if (state == 4) {
+                distance += 0x800;
+                length = 3;
+            } else {
+                length = 2;
+            }
+        } else if (t >= 64) {
+            if (ip >= ipEnd) return -1;
+            next = int(t & 3);
+            distance = 1 + ((t >> 2) & 7) + (qsizetype(*ip++) << 3);
+            length = (t >> 5) + 1;
+        } else {
+            const bool far = t < 32;
+            const qsizetype bits = far ? (t & 7) : (t & 31);
+            length = bits != 0 ? bits : lzoRunLength(ip, ipEnd, far ? 7 : 31);
+            if (length < 0 || ipEnd - ip < 2) return -1;
+            length += 2;
+            const quint16 word = qFromLittleEndian<quint16>(ip);
+            ip += 2;
+            next = word & 3;
+            if (far) {
+                distance = ((t & 8) << 11) + (word >> 2);
+                if (distance == 0) {
+                    // End of stream: 0x11 0x00 0x00. Padding after it is ignored.
+                    return length == 3 ? op - out : -1;
+                }
+                distance += 0x4000;
+            } else {
+                distance = (word >> 2) + 1;
+            }
+        }
+
+        if (distance > op - out || opEnd - op < length) return -1;
+        // Matches may overlap their own output, so copy byte by byte.
+        const uchar *match = op - distance;
+        for (qsizetype i = 0; i < length; ++i) op[i] = match[i];
+        op += length;
+
+        if (!copyLiterals(next)) return -1;
+        state = next;
+    }
+}
+
+}
+
+MdxParser::MdxParser(const QString& filePath)
+    : m_filePath(filePath), m_version(2.0), m_encrypted(0), m_numberWidth(8), m_utf16(false),
+      m_entryCount(0), m_keyBlocksOffset(0), m_recordBlocksOffset(0), m_keyBlockIndex(0), m_keyBufferPos(0) {
+}
+
+QList<Word> MdxParser::parseFile(const QString& filePath) {
+    QList<Word> words;
+    MdxParser parser(filePath);
+    parser.parse([&words](QList<Word>& batch) {
+        words.append(batch);
+        return true;
+    });
+    return words;
+}
+
+QString MdxParser::title() const {
+    return m_title;
+}
+
+qint64 MdxParser::entryCount() const {
+    return m_entryCount;
+}
+
+QString MdxParser::errorString() const {
+    return m_error;
+}
+
+bool MdxParser::fail(const QString& message) {
+    m_error = message;
+    qWarning() << "MdxParser:" << m_filePath << message;
+    return false;
+}
+
+quint64 MdxParser::readNumber(const uchar *p) const {
+    if (m_numberWidth == 8) return qFromBigEndian<quint64>(p);
+    return qFromBigEndian<quint32>(p);
+}
+
+bool MdxParser::readHeader() {
+    m_keyFile.setFileName(m_filePath);
+    if (!m_keyFile.open(QIODevice::ReadOnly)) {
+        return fail(m_keyFile.errorString());
+    }
+
+    QByteArray sizeBytes = m_keyFile.read(4);
+    if (sizeBytes.size() != 4) return fail("missing header");
+    quint32 headerSize = qFromBigEndian<quint32>(sizeBytes.constData());
+    QByteArray headerBytes = m_keyFile.read(headerSize);
+    if (headerBytes.size() != qsizetype(headerSize) || m_keyFile.read(4).size() != 4) {
+        return fail("truncated header");
+    }
+
+    QString header = QString::fromUtf16(reinterpret_cast<const char16_t*>(headerBytes.constData()), headerBytes.size() / 2);
+    static const QRegularExpression reAttr("(\\w+)=\"([^\"]*)\"");
+    QHash<QString, QString> attrs;
+    auto it = reAttr.globalMatch(header);
+    while (it.hasNext()) {
+        QRegularExpressionMatch match = it.next();
+        attrs.insert(match.captured(1), match.captured(2));
+    }
+
+    m_title = attrs.value("Title");
+    m_version = attrs.value("GeneratedByEngineVersion", "2.0").toDouble();
+    m_numberWidth = m_version >= 2.0 ? 8 : 4;
+
+    QString encoding = attrs.value("Encoding").trimmed().toUpper();
+    if (encoding.isEmpty()) encoding = "UTF-8";
+    if (encoding == "GBK" || encoding == "GB2312") encoding = "GB18030";
+    m_utf16 = encoding.startsWith("UTF-16");
+    m_encoding = encoding.toLatin1();
+
+    QString encrypted = attrs.value("Encrypted");
+    if (encrypted == "Yes") m_encrypted = 1;
+    else if (encrypted.isEmpty() || encrypted == "No") m_encrypted = 0;
+    else m_encrypted = encrypted.toInt();
+
+    if (m_encrypted & 1) {
+        return fail("record encryption requires a registration key");
+    }
+    return true;
+}
+
+bool MdxParser::readKeySection() {
+    const bool v2 = m_version >= 2.0;
+    const int w = m_numberWidth;
+    QByteArray head = m_keyFile.read(v2 ? 5 * w + 4 : 4 * w);
+    if (head.size() != (v2 ? 5 * w + 4 : 4 * w)) return fail("truncated key section");
+
+    const uchar *p = reinterpret_cast<const uchar*>(head.constData());
+    qint64 numKeyBlocks = qint64(readNumber(p)); p += w;
+    m_entryCount = qint64(readNumber(p)); p += w;
+    qint64 infoDecompSize = 0;
+    if (v2) { infoDecompSize = qint64(readNumber(p)); p += w; }
+    qint64 infoSize = qint64(readNumber(p)); p += w;
+
+    QByteArray info = m_keyFile.read(infoSize);
+    if (info.size() != infoSize) return fail("truncated key block info");
+    if (v2) {
+        if (m_encrypted & 2) info = decryptKeyBlockInfo(info);
+        bool ok = false;
+        info = decodeBlock(info, infoDecompSize, &ok);
+        if (!ok) return fail("cannot decompress key block info");
+    }
+
+    const int unit = m_utf16 ? 2 : 1;
+    const int terminator = v2 ? unit : 0;
+    const uchar *q = reinterpret_cast<const uchar*>(info.constData());
+    const uchar *end = q + info.size();
+    m_keyBlocks.clear();
+    m_keyBlocks.reserve(size_t(numKeyBlocks));
+    for (qint64 i = 0; i < numKeyBlocks; ++i) {
+        KeyBlock block;
+        if (end - q < w) return fail("corrupt key block info");
+        block.entries = qint64(readNumber(q)); q += w;
+        for (int text = 0; text < 2; ++text) {
+            if (end - q < (v2 ? 2 : 1)) return fail("corrupt key block info");
+            int size = v2 ? qFromBigEndian<quint16>(q) : *q;
+            q += v2 ? 2 : 1;
+            if (end - q < size * unit + terminator) return fail("corrupt key block info");
+            q += size * unit + terminator;
+        }
+        if (end - q < 2 * w) return fail("corrupt key block info");
+        block.compSize = qint64(readNumber(q)); q += w;
+        block.decompSize = qint64(readNumber(q)); q += w;
+        m_keyBlocks.push_back(block);
+    }
+
+    m_keyBlocksOffset = m_keyFile.pos();
+    qint64 keyBlocksSize = 0;
+    for (const KeyBlock& block : m_keyBlocks) keyBlocksSize += block.compSize;
+    m_recordBlocksOffset = m_keyBlocksOffset + keyBlocksSize;
+    m_keyBlockIndex = 0;
+    m_keyBuffer.clear();
+    m_keyBufferPos = 0;
+    return true;
+}
+
+bool MdxParser::readRecordSection() {
+    const int w = m_numberWidth;
+    m_recordFile.setFileName(m_filePath);
+    if (!m_recordFile.open(QIODevice::ReadOnly) || !m_recordFile.seek(m_recordBlocksOffset)) {
+        return fail("cannot seek to record section");
+    }
+
+    QByteArray head = m_recordFile.read(4 * w);
+    if (head.size() != 4 * w) return fail("truncated record section");
+    const uchar *p = reinterpret_cast<const uchar*>(head.constData());
+    qint64 numRecordBlocks = qint64(readNumber(p));
+    qint64 infoSize = qint64(readNumber(p + 2 * w));
+
+    QByteArray info = m_recordFile.read(infoSize);
+    if (info.size() != infoSize || infoSize < numRecordBlocks * 2 * w) return fail("truncated record block info");
+
+    const uchar *q = reinterpret_cast<const uchar*>(info.constData());
+    m_recordBlocks.clear();
+    m_recordBlocks.reserve(size_t(numRecordBlocks));
+    for (qint64 i = 0; i < numRecordBlocks; ++i) {
+        RecordBlock block;
+        block.compSize = qint64(readNumber(q)); q += w;
+        block.decompSize = qint64(readNumber(q)); q += w;
+        m_recordBlocks.push_back(block);
+    }
+    m_recordBlocksOffset = m_recordFile.pos();
+    return true;
+}
+
+bool MdxParser::nextKey(KeyEntry& entry) {
+    while (m_keyBufferPos >= m_keyBuffer.size()) {
+        if (m_keyBlockIndex >= m_keyBlocks.size()) return false;
+        const KeyBlock& block = m_keyBlocks[m_keyBlockIndex++];
+
+        QByteArray raw = m_keyFile.read(block.compSize);
+        bool ok = false;
+        QByteArray data = raw.size() == block.compSize ? decodeBlock(raw, block.decompSize, &ok) : QByteArray();
+        if (!ok) return fail("cannot read key block");
+
+        m_keyBuffer.clear();
+        m_keyBufferPos = 0;
+        const int w = m_numberWidth;
+        const char *q = data.constData();
+        const char *end = q + data.size();
+        while (end - q > w) {
+            KeyEntry key;
+            key.offset = qint64(readNumber(reinterpret_cast<const uchar*>(q)));
+            q += w;
+            const char *term = q;
+            if (m_utf16) {
+                while (end - term >= 2 && (term[0] != 0 || term[1] != 0)) term += 2;
+            } else {
+                term = static_cast<const char*>(std::memchr(q, 0, size_t(end - q)));
+                if (!term) term = end;
+            }
+            key.headword = QByteArray(q, term - q);
+            q = std::min(end, term + (m_utf16 ? 2 : 1));
+            m_keyBuffer.append(key);
+        }
+    }
+    entry = m_keyBuffer[m_keyBufferPos++];
+    return true;
+}
+
+QByteArray MdxParser::decodeBlock(const QByteArray& block, qint64 decompSize, bool *ok) const {
+    *ok = false;
+    if (block.size() < 8 || decompSize < 0) return QByteArray();
+
+    quint32 type = qFromLittleEndian<quint32>(block.constData());
+    if (type == 0) {
+        *ok = true;
+        return block.mid(8);
+    }
+    if (type == 1) {
+        QByteArray out(decompSize, Qt::Uninitialized);
+        qsizetype size = lzo1xDecompress(reinterpret_cast<const uchar*>(block.constData()) + 8, block.size() - 8,
+                                         reinterpret_cast<uchar*>(out.data()), out.size());
+        *ok = size == decompSize;
+        return out;
+    }
+    if (type == 2) {
+        QByteArray zipped;
+        zipped.reserve(block.size() - 4);
+        uchar size[4];
+        qToBigEndian<quint32>(quint32(decompSize), size);
+        zipped.append(reinterpret_cast<const char*>(size), 4);
+        zipped.append(block.constData() + 8, block.size() - 8);
+        QByteArray out = qUncompress(zipped);
+        *ok = out.size() == decompSize;
+        return out;
+    }
+    return QByteArray();
+}
+
+QString MdxParser::decodeText(const QByteArray& bytes) const {
+    qsizetype size = bytes.size();
+    if (m_utf16) {
+        size &= ~qsizetype(1);
+        while (size >= 2 && bytes[size - 1] == 0 && bytes[size - 2] == 0) size -= 2;
+        return QString::fromUtf16(reinterpret_cast<const char16_t*>(bytes.constData()), size / 2);
+    }
+    while (size > 0 && bytes[size - 1] == 0) --size;
+    if (m_encoding == "UTF-8") {
+        return QString::fromUtf8(bytes.constData(), size);
+    }
+    QStringDecoder decoder(m_encoding.constData());
+    if (decoder.isValid()) {
+        return decoder.decode(QByteArrayView(bytes.constData(), size));
+    }
+    return QString::fromLocal8Bit(bytes.constData(), size);
+}
+
+Word MdxParser::toWord(const QByteArray& headword, const QByteArray& record) const {
+    Word w;
+    QString definition = decodeText(record);
+    if (definition.startsWith("@@@LINK=")) return w;
+
+    w.spelling = decodeText(headword).trimmed();
+    w.definition = DictionaryParser::htmlToText(definition);
+    w.isFavorite = false;
+    return w;
+}
+
+bool MdxParser::parse(const Sink& sink, int batchSize) {
+    m_error.clear();
+    if (!readHeader() || !readKeySection() || !readRecordSection()) return false;
+
+    struct RawEntry {
+        QByteArray headword;
+        QByteArray record;
+    };
+
+    qint64 totalSize = 0;
+    for (const RecordBlock& block : m_recordBlocks) totalSize += block.decompSize;
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount()));
+    const size_t window = size_t(std::max(2, pool.maxThreadCount() * 2));
+
+    QByteArray buffer;
+    qint64 bufferStart = 0;
+    size_t nextBlock = 0;
+    QList<Word> batch;
+    QDateTime now = QDateTime::currentDateTime();
+
+    KeyEntry current;
+    KeyEntry next;
+    bool hasCurrent = nextKey(current);
+    bool hasNext = hasCurrent && nextKey(next);
+
+    while (hasCurrent && m_error.isEmpty()) {
+        if (nextBlock >= m_recordBlocks.size()) {
+            return fail("record data ends before the last key");
+        }
+
+        size_t count = std::min(window, m_recordBlocks.size() - nextBlock);
+        std::vector<QByteArray> compressed(count);
+        for (size_t i = 0; i < count; ++i) {
+            compressed[i] = m_recordFile.read(m_recordBlocks[nextBlock + i].compSize);
+            if (compressed[i].size() != m_recordBlocks[nextBlock + i].compSize) {
+                return fail("truncated record block");
+            }
+        }
+
+        std::vector<QByteArray> decoded(count);
+        std::vector<char> decodedOk(count, 0);
+        for (size_t i = 0; i < count; ++i) {
+            pool.start([&, i]() {
+                bool ok = false;
+                decoded[i] = decodeBlock(compressed[i], m_recordBlocks[nextBlock + i].decompSize, &ok);
+                decodedOk[i] = ok;
+            });
+        }
+        pool.waitForDone();
+        for (size_t i = 0; i < count; ++i) {
+            if (!decodedOk[i]) return fail(QString("cannot decompress record block %1").arg(nextBlock + i));
+            buffer.append(decoded[i]);
+        }
+        nextBlock += count;
+
+        std::vector<RawEntry> raw;
+        qint64 bufferEnd = bufferStart + buffer.size();
+        while (hasCurrent) {
+            qint64 end = hasNext ? next.offset : totalSize;
+            if (end > bufferEnd) break;
+            if (current.offset >= bufferStart && end >= current.offset) {
+                raw.push_back({current.headword, buffer.mid(current.offset - bufferStart, end - current.offset)});
+            }
+            current = std::move(next);
+            hasCurrent = hasNext;
+            if (hasCurrent) hasNext = nextKey(next);
+        }
+        if (!m_error.isEmpty()) return false;
+
+        qint64 keepFrom = hasCurrent ? std::clamp(current.offset, bufferStart, bufferEnd) : bufferEnd;
+        buffer.remove(0, keepFrom - bufferStart);
+        bufferStart = keepFrom;
+
+        std::vector<Word> words(raw.size());
+        const size_t chunk = 256;
+        for (size_t start = 0; start < raw.size(); start += chunk) {
+            pool.start([&, start]() {
+                size_t stop = std::min(raw.size(), start + chunk);
+                for (size_t i = start; i < stop; ++i) {
+                    words[i] = toWord(raw[i].headword, raw[i].record);
+                }
+            });
+        }
+        pool.waitForDone();
+
+        for (Word& w : words) {
+            if (w.spelling.isEmpty()) continue;
+            w.createdAt = now;
+            batch.append(std::move(w));
+            if (batch.size() >= batchSize) {
+                if (!sink(batch)) return fail("import cancelled");
+                batch.clear();
+            }
+        }
+    }
+
+    if (!m_error.isEmpty()) return false;
+    if (!batch.isEmpty() && !sink(batch)) return fail("import cancelled");
+    return true;
+}
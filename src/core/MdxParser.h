@@ -0,0 +1,73 @@
+#pragma once
+#include "Word.h"
+#include <QFile>
+#include <QList>
+#include <QString>
+#include <functional>
+#include <vector>
+
+// Streams an MDict (.mdx) dictionary: key blocks and record blocks are read
+// one window at a time and decompressed on a thread pool, so memory stays
+// bounded by the window size rather than the file size.
+class MdxParser {
+public:
+    using Sink = std::function<bool(QList<Word>& batch)>;
+
+    explicit MdxParser(const QString& filePath);
+
+    bool parse(const Sink& sink, int batchSize = 2000);
+    static QList<Word> parseFile(const QString& filePath);
+
+    QString title() const;
+    qint64 entryCount() const;
+    QString errorString() const;
+
+private:
+    struct KeyBlock {
+        qint64 entries = 0;
+        qint64 compSize = 0;
+        qint64 decompSize = 0;
+    };
+
+    struct RecordBlock {
+        qint64 compSize = 0;
+        qint64 decompSize = 0;
+    };
+
+    struct KeyEntry {
+        qint64 offset = 0;
+        QByteArray headword;
+    };
+
+    bool readHeader();
+    bool readKeySection();
+    bool readRecordSection();
+    bool nextKey(KeyEntry& entry);
+    bool fail(const QString& message);
+
+    quint64 readNumber(const uchar *p) const;
+    QString decodeText(const QByteArray& bytes) const;
+    QByteArray decodeBlock(const QByteArray& block, qint64 decompSize, bool *ok) const;
+    Word toWord(const QByteArray& headword, const QByteArray& record) const;
+
+    QString m_filePath;
+    QFile m_keyFile;
+    QFile m_recordFile;
+    QString m_error;
+    QString m_title;
+    QByteArray m_encoding;
+    double m_version;
+    int m_encrypted;
+    int m_numberWidth;
+    bool m_utf16;
+
+    qint64 m_entryCount;
+    std::vector<KeyBlock> m_keyBlocks;
+    qint64 m_keyBlocksOffset;
+    std::vector<RecordBlock> m_recordBlocks;
+    qint64 m_recordBlocksOffset;
+
+    size_t m_keyBlockIndex;
+    QList<KeyEntry> m_keyBuffer;
+    int m_keyBufferPos;
+};
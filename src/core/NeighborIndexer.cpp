@@ -0,0 +1,359 @@
+#include "NeighborIndexer.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QMutex>
+#include <QSet>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <QtGlobal>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <utility>
+
+namespace {
+
+const int kSignatureWords = 4;
+const int kSignatureBits = kSignatureWords * 64;
+// Candidates kept from the signature pass per word, as a multiple of k.
+const int kCandidateFactor = 4;
+// All-pairs cost grows with the square of the book; larger books are skipped.
+const int kMaxWords = 100000;
+// Rows scanned between checks of the cancel flag.
+const int kRowBlock = 64;
+// Words whose neighbour rows are written per transaction.
+const int kStoreChunk = 2000;
+
+QMutex g_runningMutex;
+QWaitCondition g_idle;
+QSet<int> g_running;
+std::atomic_bool g_cancelled{false};
+
+quint32 gramHash(const QChar *c, int len) {
+    quint32 h = 2166136261u;
+    for (int i = 0; i < len; ++i) {
+        h = (h ^ c[i].unicode()) * 16777619u;
+    }
+    return h % kSignatureBits;
+}
+
+void addGrams(quint64 *sig, const QString& text, int n) {
+    for (int i = 0; i + n <= text.size(); ++i) {
+        const quint32 bit = gramHash(text.constData() + i, n);
+        sig[bit >> 6] |= quint64(1) << (bit & 63);
+    }
+}
+
+int countBits(const quint64 *sig) {
+    int count = 0;
+    for (int w = 0; w < kSignatureWords; ++w) count += qPopulationCount(sig[w]);
+    return count;
+}
+
+// Boundary markers make prefix and suffix grams distinct from inner ones.
+QString spellingText(const QString& spelling) {
+    return "^" + spelling.trimmed().toLower() + "$";
+}
+
+// Keeps the letters that carry meaning: CJK characters when there are any,
+// otherwise the lowercase Latin letters. Part-of-speech tags such as "n."
+// would otherwise match almost every definition.
+QString definitionText(const QString& definition) {
+    QString wide;
+    QString latin;
+    for (QChar c : definition) {
+        if (!c.isLetter()) continue;
+        if (c.unicode() > 0x7f) wide.append(c);
+        else latin.append(c.toLower());
+    }
+    return wide.isEmpty() ? latin : wide;
+}
+
+double jaccard(const quint64 *a, const quint64 *b, int countA, int countB) {
+    int common = 0;
+    for (int w = 0; w < kSignatureWords; ++w) common += qPopulationCount(a[w] & b[w]);
+    const int all = countA + countB - common;
+    return all > 0 ? double(common) / all : 0.0;
+}
+
+int editDistance(const QString& a, const QString& b) {
+    std::vector<int> row(b.size() + 1);
+    for (int j = 0; j <= b.size(); ++j) row[j] = j;
+    for (int i = 1; i <= a.size(); ++i) {
+        int diagonal = row[0];
+        row[0] = i;
+        for (int j = 1; j <= b.size(); ++j) {
+            const int above = row[j];
+            row[j] = std::min({row[j] + 1, row[j - 1] + 1, diagonal + (a[i - 1] == b[j - 1] ? 0 : 1)});
+            diagonal = above;
+        }
+    }
+    return row[b.size()];
+}
+
+// A pair is confusable if either side is close; closeness on both counts extra.
+double combine(double spelling, double definition) {
+    return std::max(spelling, definition) + 0.25 * std::min(spelling, definition);
+}
+
+}
+
+NeighborIndexer::NeighborIndexer(int bookId, int k)
+    : m_bookId(bookId), m_k(k), m_indexed(0) {
+}
+
+int NeighborIndexer::indexedWords() const {
+    return m_indexed;
+}
+
+QString NeighborIndexer::errorString() const {
+    return m_error;
+}
+
+bool NeighborIndexer::startInBackground(int bookId) {
+    {
+        QMutexLocker lock(&g_runningMutex);
+        if (g_cancelled || g_running.contains(bookId)) return false;
+        g_running.insert(bookId);
+    }
+    QThreadPool::globalInstance()->start([bookId]() {
+        NeighborIndexer indexer(bookId);
+        if (!indexer.run() && !g_cancelled) {
+            qWarning() << "NeighborIndexer: book" << bookId << indexer.errorString();
+        }
+        QMutexLocker lock(&g_runningMutex);
+        g_running.remove(bookId);
+        g_idle.wakeAll();
+    });
+    return true;
+}
+
+void NeighborIndexer::cancelAll() {
+    QMutexLocker lock(&g_runningMutex);
+    g_cancelled = true;
+    while (!g_running.isEmpty()) g_idle.wait(&g_runningMutex);
+}
+
+bool NeighborIndexer::run() {
+    m_indexed = 0;
+    m_error.clear();
+
+    const QString connection = QString("neighbors-%1").arg(quintptr(QThread::currentThreadId()), 0, 16);
+    bool ok = false;
+    {
+        QSqlDatabase db = QSqlDatabase::cloneDatabase(QSqlDatabase::defaultConnection, connection);
+        if (!db.open()) {
+            m_error = db.lastError().text();
+        } else {
+            ok = index(db);
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(connection);
+    return ok;
+}
+
+bool NeighborIndexer::index(QSqlDatabase& db) {
+    m_ids.clear();
+    m_spellings.clear();
+    m_definitions.clear();
+
+    QString sql = "SELECT id, spelling, definition FROM words";
+    if (m_bookId != -1) {
+        sql += QString(" WHERE book_id = %1").arg(m_bookId);
+    } else {
+        sql += " GROUP BY id";
+    }
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.exec(sql)) {
+        m_error = query.lastError().text();
+        return false;
+    }
+    while (query.next()) {
+        m_ids.append(query.value(0).toInt());
+        m_spellings.append(query.value(1).toString());
+        m_definitions.append(query.value(2).toString());
+    }
+    query.finish();
+
+    const int n = int(m_ids.size());
+    std::vector<QList<int>> neighbors(n);
+    if (n > kMaxWords) {
+        // Still marked as indexed below, so tests do not retry it every time.
+        qWarning() << "NeighborIndexer: book" << m_bookId << "has" << n << "words, skipped";
+    } else if (!computeNeighbors(neighbors)) {
+        m_error = "cancelled";
+        return false;
+    }
+    return store(db, neighbors);
+}
+
+bool NeighborIndexer::computeNeighbors(std::vector<QList<int>>& neighbors) {
+    const int n = int(m_ids.size());
+    m_spellingBits.assign(size_t(n) * kSignatureWords, 0);
+    m_definitionBits.assign(size_t(n) * kSignatureWords, 0);
+    m_spellingCounts.resize(n);
+    m_definitionCounts.resize(n);
+    for (int i = 0; i < n; ++i) {
+        quint64 *spelling = &m_spellingBits[size_t(i) * kSignatureWords];
+        const QString s = spellingText(m_spellings[i]);
+        addGrams(spelling, s, 2);
+        addGrams(spelling, s, 3);
+        m_spellingCounts[i] = countBits(spelling);
+
+        quint64 *definition = &m_definitionBits[size_t(i) * kSignatureWords];
+        const QString d = definitionText(m_definitions[i]);
+        addGrams(definition, d, 1);
+        addGrams(definition, d, 2);
+        m_definitionCounts[i] = countBits(definition);
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount()));
+    const int parts = std::max(1, std::min(n / 256 + 1, pool.maxThreadCount() * 4));
+    for (int p = 0; p < parts; ++p) {
+        pool.start([&, p]() {
+            const int first = int(qint64(n) * p / parts);
+            const int last = int(qint64(n) * (p + 1) / parts);
+            for (int block = first; block < last && !g_cancelled; block += kRowBlock) {
+                const int end = std::min(last, block + kRowBlock);
+                for (int i = block; i < end; ++i) neighbors[i] = neighborsOf(i);
+            }
+        });
+    }
+    pool.waitForDone();
+    return !g_cancelled;
+}
+
+bool NeighborIndexer::store(QSqlDatabase& db, const std::vector<QList<int>>& neighbors) {
+    const int n = int(m_ids.size());
+
+    // The old lists and the marker go first; the new rows follow one chunk
+    // per transaction, so no single write holds the database for the whole
+    // book. Until the marker is written again the book reads as stale, and
+    // an interrupted run is simply redone.
+    if (!db.transaction()) {
+        m_error = db.lastError().text();
+        return false;
+    }
+    QSqlQuery remove(db);
+    remove.prepare("DELETE FROM word_neighbors WHERE book_id = :book_id");
+    remove.bindValue(":book_id", m_bookId);
+    QSqlQuery unmark(db);
+    unmark.prepare("DELETE FROM neighbor_index WHERE book_id = :book_id");
+    unmark.bindValue(":book_id", m_bookId);
+    if (!remove.exec() || !unmark.exec()) {
+        m_error = remove.lastError().isValid() ? remove.lastError().text() : unmark.lastError().text();
+        db.rollback();
+        return false;
+    }
+    if (!db.commit()) {
+        m_error = db.lastError().text();
+        db.rollback();
+        return false;
+    }
+
+    QSqlQuery insert(db);
+    insert.prepare("INSERT INTO word_neighbors (book_id, word_id, neighbor_id, rank) "
+                   "VALUES (:book_id, :word_id, :neighbor_id, :rank)");
+    for (int first = 0; first < n; first += kStoreChunk) {
+        if (g_cancelled) {
+            m_error = "cancelled";
+            return false;
+        }
+        if (!db.transaction()) {
+            m_error = db.lastError().text();
+            return false;
+        }
+        const int last = std::min(n, first + kStoreChunk);
+        for (int i = first; i < last; ++i) {
+            for (int r = 0; r < neighbors[i].size(); ++r) {
+                insert.bindValue(":book_id", m_bookId);
+                insert.bindValue(":word_id", m_ids[i]);
+                insert.bindValue(":neighbor_id", m_ids[neighbors[i][r]]);
+                insert.bindValue(":rank", r);
+                if (!insert.exec()) {
+                    m_error = insert.lastError().text();
+                    db.rollback();
+                    return false;
+                }
+            }
+        }
+        if (!db.commit()) {
+            m_error = db.lastError().text();
+            db.rollback();
+            return false;
+        }
+    }
+
+    // The marker, not the rows, says the book is indexed: words without
+    // neighbours and skipped books store no rows at all.
+    QSqlQuery mark(db);
+    mark.prepare("INSERT OR REPLACE INTO neighbor_index (book_id, word_count, indexed_at) "
+                 "VALUES (:book_id, :word_count, :indexed_at)");
+    mark.bindValue(":book_id", m_bookId);
+    mark.bindValue(":word_count", n);
+    mark.bindValue(":indexed_at", QDateTime::currentDateTime());
+    if (!mark.exec()) {
+        m_error = mark.lastError().text();
+        return false;
+    }
+    m_indexed = n;
+    return true;
+}
+
+QList<int> NeighborIndexer::neighborsOf(int row) const {
+    const int n = int(m_ids.size());
+    const int keep = m_k * kCandidateFactor;
+    const quint64 *spelling = &m_spellingBits[size_t(row) * kSignatureWords];
+    const quint64 *definition = &m_definitionBits[size_t(row) * kSignatureWords];
+    const QString ownDefinition = m_definitions[row].trimmed();
+
+    // Min-heap of the best signature scores seen so far.
+    using Candidate = std::pair<double, int>;
+    std::vector<Candidate> heap;
+    heap.reserve(keep + 1);
+    for (int j = 0; j < n; ++j) {
+        if (j == row) continue;
+        const double s = jaccard(spelling, &m_spellingBits[size_t(j) * kSignatureWords],
+                                 m_spellingCounts[row], m_spellingCounts[j]);
+        const double d = jaccard(definition, &m_definitionBits[size_t(j) * kSignatureWords],
+                                 m_definitionCounts[row], m_definitionCounts[j]);
+        const double score = combine(s, d);
+        if (int(heap.size()) < keep) {
+            heap.emplace_back(score, j);
+            std::push_heap(heap.begin(), heap.end(), std::greater<Candidate>());
+        } else if (score > heap.front().first) {
+            std::pop_heap(heap.begin(), heap.end(), std::greater<Candidate>());
+            heap.back() = {score, j};
+            std::push_heap(heap.begin(), heap.end(), std::greater<Candidate>());
+        }
+    }
+
+    // Rerank the survivors with the exact spelling distance. Words with the
+    // same definition would make a second correct answer and are dropped.
+    const QString ownSpelling = m_spellings[row].trimmed().toLower();
+    std::vector<Candidate> ranked;
+    ranked.reserve(heap.size());
+    for (const Candidate& c : heap) {
+        const int j = c.second;
+        if (m_definitions[j].trimmed() == ownDefinition) continue;
+        const QString other = m_spellings[j].trimmed().toLower();
+        if (other == ownSpelling) continue;
+        const int longest = int(std::max(ownSpelling.size(), other.size()));
+        const double s = longest > 0 ? 1.0 - double(editDistance(ownSpelling, other)) / longest : 0.0;
+        const double d = jaccard(definition, &m_definitionBits[size_t(j) * kSignatureWords],
+                                 m_definitionCounts[row], m_definitionCounts[j]);
+        ranked.emplace_back(combine(s, d), j);
+    }
+    std::sort(ranked.begin(), ranked.end(), std::greater<Candidate>());
+
+    QList<int> result;
+    for (int i = 0; i < int(ranked.size()) && i < m_k; ++i) result.append(ranked[i].second);
+    return result;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <QList>
+#include <QSqlDatabase>
+#include <QString>
+#include <QStringList>
+#include <vector>
+
+// Precomputes, for every word of a book, the k words most easily confused
+// with it: similar spelling (shared n-grams and affixes, reranked by edit
+// distance) or similar definition (shared character n-grams). Results go to
+// the word_neighbors table, so building a test question is a lookup, and each
+// run records the book's word count in neighbor_index.
+//
+// Candidates are found with 256-bit n-gram signatures compared by AND and
+// popcount over flat arrays, split across a thread pool; only the best few
+// per word get the exact edit distance. Rows are scanned and stored in
+// blocks, and cancelAll() stops every run at the next block.
+class NeighborIndexer {
+public:
+    explicit NeighborIndexer(int bookId, int k = 8);
+
+    // Runs on the calling thread with its own database connection.
+    bool run();
+    // Runs on the global thread pool; returns false if the book is already
+    // being indexed or indexing was cancelled.
+    static bool startInBackground(int bookId);
+    // Stops running indexers at their next block of rows, waits for them and
+    // refuses new runs; called on quit. A stopped book has no index marker,
+    // so it is rebuilt on the next start.
+    static void cancelAll();
+
+    int indexedWords() const;
+    QString errorString() const;
+
+private:
+    bool index(QSqlDatabase& db);
+    bool computeNeighbors(std::vector<QList<int>>& neighbors);
+    bool store(QSqlDatabase& db, const std::vector<QList<int>>& neighbors);
+    QList<int> neighborsOf(int row) const;
+
+    int m_bookId;
+    int m_k;
+    int m_indexed;
+    QString m_error;
+
+    QList<int> m_ids;
+    QStringList m_spellings;
+    QStringList m_definitions;
+    std::vector<quint64> m_spellingBits;
+    std::vector<quint64> m_definitionBits;
+    std::vector<int> m_spellingCounts;
+    std::vector<int> m_definitionCounts;
+};
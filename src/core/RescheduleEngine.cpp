@@ -0,0 +1,176 @@
+#include "RescheduleEngine.h"
+#include "../db/DatabaseManager.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+static const int CHUNK_SIZE = 65536;
+
+RescheduleEngine::RescheduleEngine(const FsrsScheduler& scheduler)
+    : m_scheduler(scheduler), m_cards(0) {
+}
+
+int RescheduleEngine::rescheduledCards() const {
+    return m_cards;
+}
+
+QString RescheduleEngine::errorString() const {
+    return m_error;
+}
+
+RescheduleEngine::Result RescheduleEngine::run(const Progress& progress) {
+    m_cards = 0;
+    m_error.clear();
+
+    // Cards with reviews from before review_logs existed have a shorter log
+    // than their rep count; replaying that log alone would reset them. Test
+    // answers are replayed too: TestView applied them through schedule(), so
+    // they are part of how the card got where it is. Checks left the card
+    // untouched and are skipped.
+    const QString complete = "SELECT c.word_id FROM cards c "
+                             "JOIN (SELECT word_id, COUNT(*) AS n FROM review_logs WHERE kind <> 2 GROUP BY word_id) g "
+                             "ON g.word_id = c.word_id WHERE c.reps = g.n";
+
+    QSqlDatabase db = DatabaseManager::instance().database();
+    int total = 0;
+    QSqlQuery count(db);
+    if (count.exec(QString("SELECT COUNT(*) FROM (%1)").arg(complete)) && count.next()) {
+        total = count.value(0).toInt();
+    }
+    count.finish();
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.exec(QString("SELECT l.word_id, l.rating, l.reviewed_at FROM review_logs l "
+                            "WHERE l.kind <> 2 AND l.word_id IN (%1) "
+                            "ORDER BY l.word_id, l.reviewed_at, l.id").arg(complete))) {
+        m_error = query.lastError().text();
+        return Result::Failed;
+    }
+
+    // Timestamps stay as text here and are parsed on the workers.
+    QList<Sequence> chunk;
+    chunk.reserve(CHUNK_SIZE);
+    while (query.next()) {
+        int wordId = query.value(0).toInt();
+        int rating = query.value(1).toInt();
+        if (rating < FsrsRating::Again || rating > FsrsRating::Easy) continue;
+
+        if (chunk.isEmpty() || chunk.last().wordId != wordId) {
+            if (chunk.size() == CHUNK_SIZE) {
+                if (!flush(chunk)) return Result::Failed;
+                if (progress && !progress(m_cards, total)) return Result::Cancelled;
+            }
+            Sequence sequence;
+            sequence.wordId = wordId;
+            chunk.append(sequence);
+        }
+        chunk.last().ratings.append(rating);
+        chunk.last().reviewedAt.append(query.value(2).toString());
+    }
+    query.finish();
+
+    if (!chunk.isEmpty() && !flush(chunk)) return Result::Failed;
+    if (progress) progress(m_cards, total);
+    return Result::Finished;
+}
+
+bool RescheduleEngine::flush(QList<Sequence>& chunk) {
+    const int count = int(chunk.size());
+    QThreadPool pool;
+    pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount()));
+    const int parts = std::max(1, std::min(count / 1024 + 1, pool.maxThreadCount() * 2));
+    std::vector<QList<FsrsCard>> results(parts);
+
+    for (int p = 0; p < parts; ++p) {
+        pool.start([&, p]() {
+            const int first = int(qint64(count) * p / parts);
+            const int last = int(qint64(count) * (p + 1) / parts);
+            results[p] = replay(chunk.constData() + first, last - first);
+        });
+    }
+    pool.waitForDone();
+
+    QList<FsrsCard> cards;
+    cards.reserve(count);
+    for (const QList<FsrsCard>& part : results) cards += part;
+    if (!DatabaseManager::instance().updateCards(cards)) {
+        m_error = "failed to write cards";
+        return false;
+    }
+    m_cards += count;
+    chunk.clear();
+    return true;
+}
+
+QList<FsrsCard> RescheduleEngine::replay(const Sequence *sequences, int count) const {
+    // Lanes are ordered longest history first, so the lanes still replaying
+    // at step k are always a prefix and scheduleBatch() needs no gather.
+    std::vector<int> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [sequences](int a, int b) {
+        return sequences[a].ratings.size() > sequences[b].ratings.size();
+    });
+
+    FsrsCardBatch batch;
+    batch.resize(count);
+    std::fill(batch.stability.begin(), batch.stability.end(), 0.0);
+    std::fill(batch.difficulty.begin(), batch.difficulty.end(), 0.0);
+    std::fill(batch.state.begin(), batch.state.end(), 0);
+    std::fill(batch.elapsedDays.begin(), batch.elapsedDays.end(), 0);
+    std::fill(batch.scheduledDays.begin(), batch.scheduledDays.end(), 0);
+    std::fill(batch.reps.begin(), batch.reps.end(), 0);
+    std::fill(batch.lapses.begin(), batch.lapses.end(), 0);
+
+    std::vector<QDateTime> lastReview(count);
+    std::vector<QDateTime> dueBase(count);
+    std::vector<int> dueDays(count, 0);
+    std::vector<int> dueSecs(count, 0);
+    QList<int> ratings;
+
+    int active = count;
+    for (int k = 0; active > 0; ++k) {
+        while (active > 0 && sequences[order[active - 1]].ratings.size() <= k) --active;
+        if (active == 0) break;
+
+        ratings.resize(active);
+        for (int j = 0; j < active; ++j) {
+            const Sequence& sequence = sequences[order[j]];
+            const QDateTime reviewedAt = QDateTime::fromString(sequence.reviewedAt[k], Qt::ISODateWithMs);
+            ratings[j] = sequence.ratings[k];
+            batch.elapsedDays[j] = lastReview[j].isValid() && reviewedAt.isValid()
+                ? int(lastReview[j].daysTo(reviewedAt)) : 0;
+            batch.dueSecs[j] = -1;
+            lastReview[j] = reviewedAt;
+        }
+        m_scheduler.scheduleBatch(batch, ratings);
+        for (int j = 0; j < active; ++j) {
+            if (batch.dueSecs[j] < 0) continue;
+            dueBase[j] = lastReview[j];
+            dueDays[j] = batch.dueSecs[j] == 0 ? batch.scheduledDays[j] : 0;
+            dueSecs[j] = batch.dueSecs[j];
+        }
+    }
+
+    QList<FsrsCard> cards;
+    cards.reserve(count);
+    for (int j = 0; j < count; ++j) {
+        FsrsCard card;
+        card.wordId = sequences[order[j]].wordId;
+        card.state = batch.state[j];
+        card.stability = batch.stability[j];
+        card.difficulty = batch.difficulty[j];
+        card.elapsedDays = batch.elapsedDays[j];
+        card.scheduledDays = batch.scheduledDays[j];
+        card.reps = batch.reps[j];
+        card.lapses = batch.lapses[j];
+        card.lastReview = lastReview[j];
+        card.due = dueBase[j].isValid() ? dueBase[j].addDays(dueDays[j]).addSecs(dueSecs[j]) : lastReview[j];
+        cards.append(card);
+    }
+    return cards;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "FsrsScheduler.h"
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+// Recomputes reviewed cards from their review_logs history with the current
+// scheduler, e.g. after new weights or a new target retention. Only cards
+// whose log holds every review (logged count equals cards.reps) are replayed;
+// cards reviewed before logging began keep their schedule. Histories are
+// streamed from SQLite in chunks, replayed on a thread pool through
+// scheduleBatch() and written back one transaction per chunk.
+class RescheduleEngine {
+public:
+    enum class Result {
+        Finished,
+        // Stopped by the progress callback; chunks already written stay written.
+        Cancelled,
+        Failed
+    };
+
+    // Return false to cancel.
+    using Progress = std::function<bool(int done, int total)>;
+
+    explicit RescheduleEngine(const FsrsScheduler& scheduler = FsrsScheduler());
+
+    Result run(const Progress& progress = Progress());
+
+    int rescheduledCards() const;
+    QString errorString() const;
+
+private:
+    struct Sequence {
+        int wordId = -1;
+        QList<int> ratings;
+        QStringList reviewedAt;
+    };
+
+    QList<FsrsCard> replay(const Sequence *sequences, int count) const;
+    bool flush(QList<Sequence>& chunk);
+
+    FsrsScheduler m_scheduler;
+    int m_cards;
+    QString m_error;
+};
@@ -0,0 +1,233 @@
+#include "SpeechCache.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
+#include <algorithm>
+
+namespace {
+
+// Clips held in memory, in KiB of PCM.
+const int kMemoryBudgetKb = 8 * 1024;
+const int kWavHeaderSize = 44;
+
+QByteArray wavHeader(const QAudioFormat& format, qint64 dataBytes) {
+    const int bits = format.bytesPerSample() * 8;
+    const quint16 tag = format.sampleFormat() == QAudioFormat::Float ? 3 : 1;
+    QByteArray header;
+    QDataStream out(&header, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData("RIFF", 4);
+    out << quint32(36 + dataBytes);
+    out.writeRawData("WAVEfmt ", 8);
+    out << quint32(16) << tag << quint16(format.channelCount()) << quint32(format.sampleRate())
+        << quint32(format.bytesPerFrame() * format.sampleRate()) << quint16(format.bytesPerFrame())
+        << quint16(bits);
+    out.writeRawData("data", 4);
+    out << quint32(dataBytes);
+    return header;
+}
+
+// Reads the fixed 44-byte header written above; other layouts are rejected.
+bool parseWav(const QByteArray& data, QAudioFormat& format, QByteArray& pcm) {
+    if (data.size() < kWavHeaderSize || !data.startsWith("RIFF") || data.mid(8, 8) != "WAVEfmt "
+        || data.mid(36, 4) != "data") {
+        return false;
+    }
+    QDataStream in(data);
+    in.setByteOrder(QDataStream::LittleEndian);
+    in.skipRawData(20);
+    quint16 tag, channels, blockAlign, bits;
+    quint32 rate, byteRate, dataBytes;
+    in >> tag >> channels >> rate >> byteRate >> blockAlign >> bits;
+    in.skipRawData(4);
+    in >> dataBytes;
+
+    QAudioFormat::SampleFormat sampleFormat = QAudioFormat::Unknown;
+    if (tag == 3 && bits == 32) sampleFormat = QAudioFormat::Float;
+    else if (tag == 1 && bits == 8) sampleFormat = QAudioFormat::UInt8;
+    else if (tag == 1 && bits == 16) sampleFormat = QAudioFormat::Int16;
+    else if (tag == 1 && bits == 32) sampleFormat = QAudioFormat::Int32;
+    if (sampleFormat == QAudioFormat::Unknown || channels == 0 || rate == 0
+        || kWavHeaderSize + qint64(dataBytes) > data.size()) {
+        return false;
+    }
+
+    format.setSampleFormat(sampleFormat);
+    format.setChannelCount(channels);
+    format.setSampleRate(int(rate));
+    pcm = data.mid(kWavHeaderSize, dataBytes);
+    return true;
+}
+
+}
+
+SpeechCache::SpeechCache(QObject *parent)
+    : QObject(parent), m_diskBytes(0) {
+    m_dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/speech";
+    QDir().mkpath(m_dir);
+
+    QSettings settings("AutoWord", "Config");
+    m_maxDiskBytes = qint64(settings.value("Tts/CacheMB", 64).toInt()) * 1024 * 1024;
+    m_memory.setMaxCost(kMemoryBudgetKb);
+
+    m_synth = new QTextToSpeech(this);
+    connect(m_synth, &QTextToSpeech::stateChanged, this, &SpeechCache::onStateChanged);
+    scanDirectory();
+}
+
+void SpeechCache::setVoice(const QVoice& voice) {
+    m_synth->setVoice(voice);
+    m_voiceName = voice.name();
+}
+
+void SpeechCache::setMaxDiskBytes(qint64 bytes) {
+    m_maxDiskBytes = bytes;
+    trim();
+}
+
+QString SpeechCache::keyFor(const QString& text) const {
+    return QString::fromLatin1(QCryptographicHash::hash((m_voiceName + '\n' + text).toUtf8(),
+                                                        QCryptographicHash::Sha1).toHex());
+}
+
+QString SpeechCache::pathFor(const QString& key) const {
+    return m_dir + "/" + key + ".wav";
+}
+
+void SpeechCache::scanDirectory() {
+    m_entries.clear();
+    m_diskBytes = 0;
+    const QFileInfoList files = QDir(m_dir).entryInfoList({"*.wav"}, QDir::Files);
+    for (const QFileInfo& info : files) {
+        m_entries.insert(info.completeBaseName(), {info.size(), info.lastModified().toMSecsSinceEpoch()});
+        m_diskBytes += info.size();
+    }
+    trim();
+}
+
+void SpeechCache::prefetch(const QStringList& texts) {
+    for (const QString& raw : texts) {
+        const QString text = raw.trimmed();
+        if (text.isEmpty()) continue;
+        const QString key = keyFor(text);
+        if (m_entries.contains(key) || m_queued.contains(key)) continue;
+        m_queue.append(text);
+        m_queued.insert(key);
+    }
+    if (m_current.isEmpty()) synthesizeNext();
+}
+
+bool SpeechCache::contains(const QString& text) const {
+    return m_entries.contains(keyFor(text.trimmed()));
+}
+
+bool SpeechCache::lookup(const QString& text, QByteArray& pcm, QAudioFormat& format) {
+    const QString key = keyFor(text.trimmed());
+    if (const Clip *clip = m_memory.object(key)) {
+        pcm = clip->pcm;
+        format = clip->format;
+        touch(key);
+        return true;
+    }
+    auto entry = m_entries.find(key);
+    if (entry == m_entries.end()) return false;
+
+    QFile file(pathFor(key));
+    if (!file.open(QIODevice::ReadOnly) || !parseWav(file.readAll(), format, pcm)) {
+        qWarning() << "SpeechCache: dropping unreadable clip" << file.fileName();
+        file.close();
+        file.remove();
+        m_diskBytes -= entry.value().size;
+        m_entries.erase(entry);
+        return false;
+    }
+    file.close();
+    m_memory.insert(key, new Clip{format, pcm}, int(std::max<qint64>(1, pcm.size() / 1024)));
+    touch(key);
+    return true;
+}
+
+void SpeechCache::synthesizeNext() {
+    while (!m_queue.isEmpty()) {
+        const QString text = m_queue.takeFirst();
+        if (m_entries.contains(keyFor(text))) {
+            m_queued.remove(keyFor(text));
+            continue;
+        }
+        m_current = text;
+        m_currentPcm.clear();
+        m_synth->synthesize(text, this, [this](const QAudioFormat& format, const QByteArray& bytes) {
+            m_currentFormat = format;
+            m_currentPcm += bytes;
+        });
+        return;
+    }
+}
+
+void SpeechCache::onStateChanged(QTextToSpeech::State state) {
+    if (m_current.isEmpty()) return;
+    if (state != QTextToSpeech::Ready && state != QTextToSpeech::Error) return;
+
+    const QString key = keyFor(m_current);
+    if (state == QTextToSpeech::Ready && !m_currentPcm.isEmpty()) {
+        store(key, m_currentFormat, m_currentPcm);
+    }
+    m_queued.remove(key);
+    m_current.clear();
+    m_currentPcm.clear();
+    synthesizeNext();
+}
+
+void SpeechCache::store(const QString& key, const QAudioFormat& format, const QByteArray& pcm) {
+    QSaveFile file(pathFor(key));
+    if (!file.open(QIODevice::WriteOnly)) return;
+    file.write(wavHeader(format, pcm.size()));
+    file.write(pcm);
+    if (!file.commit()) return;
+
+    const qint64 size = kWavHeaderSize + pcm.size();
+    auto old = m_entries.constFind(key);
+    if (old != m_entries.constEnd()) m_diskBytes -= old.value().size;
+    m_entries.insert(key, {size, QDateTime::currentMSecsSinceEpoch()});
+    m_diskBytes += size;
+    m_memory.insert(key, new Clip{format, pcm}, int(std::max<qint64>(1, pcm.size() / 1024)));
+    trim();
+}
+
+void SpeechCache::touch(const QString& key) {
+    const QDateTime now = QDateTime::currentDateTime();
+    m_entries[key].lastUsed = now.toMSecsSinceEpoch();
+    // The file time carries the order across restarts.
+    QFile file(pathFor(key));
+    if (file.open(QIODevice::ReadWrite)) {
+        file.setFileTime(now, QFileDevice::FileModificationTime);
+    }
+}
+
+void SpeechCache::trim() {
+    if (m_diskBytes <= m_maxDiskBytes) return;
+
+    QList<QPair<qint64, QString>> byAge;
+    byAge.reserve(m_entries.size());
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        byAge.append({it.value().lastUsed, it.key()});
+    }
+    std::sort(byAge.begin(), byAge.end());
+
+    // Trim a little below the budget so a full cache does not evict on
+    // every new clip.
+    const qint64 target = m_maxDiskBytes - m_maxDiskBytes / 10;
+    for (const auto& item : byAge) {
+        if (m_diskBytes <= target) break;
+        QFile::remove(pathFor(item.second));
+        m_diskBytes -= m_entries.value(item.second).size;
+        m_entries.remove(item.second);
+        m_memory.remove(item.second);
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <QObject>
+#include <QAudioFormat>
+#include <QCache>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include <QTextToSpeech>
+
+// Synthesized speech kept as WAV files under the cache directory, keyed by
+// voice and text, with the most recent clips also held in memory. Upcoming
+// words are synthesized ahead of time, one at a time, on a QTextToSpeech
+// instance of its own so live speech is never interrupted. The directory is
+// trimmed to a size budget, least recently used first.
+class SpeechCache : public QObject {
+    Q_OBJECT
+
+public:
+    explicit SpeechCache(QObject *parent = nullptr);
+
+    void setVoice(const QVoice& voice);
+    void setMaxDiskBytes(qint64 bytes);
+
+    // Queues the texts that are not cached yet; earlier requests go first.
+    void prefetch(const QStringList& texts);
+    bool contains(const QString& text) const;
+    // PCM samples and their format; false if the text is not cached.
+    bool lookup(const QString& text, QByteArray& pcm, QAudioFormat& format);
+
+private:
+    struct Clip {
+        QAudioFormat format;
+        QByteArray pcm;
+    };
+    struct Entry {
+        qint64 size;
+        qint64 lastUsed;
+    };
+
+    QString keyFor(const QString& text) const;
+    QString pathFor(const QString& key) const;
+    void scanDirectory();
+    void synthesizeNext();
+    void onStateChanged(QTextToSpeech::State state);
+    void store(const QString& key, const QAudioFormat& format, const QByteArray& pcm);
+    void touch(const QString& key);
+    void trim();
+
+    QTextToSpeech *m_synth;
+    QString m_voiceName;
+    QString m_dir;
+
+    QStringList m_queue;
+    QSet<QString> m_queued;
+    QString m_current;
+    QAudioFormat m_currentFormat;
+    QByteArray m_currentPcm;
+
+    QHash<QString, Entry> m_entries;
+    qint64 m_diskBytes;
+    qint64 m_maxDiskBytes;
+    QCache<QString, Clip> m_memory;
+};
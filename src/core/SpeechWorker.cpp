@@ -0,0 +1,120 @@
+#include "SpeechWorker.h"
+#include <QDebug>
+#include <QSettings>
+
+SpeechWorker::SpeechWorker(QObject *parent)
+    : QObject(parent), m_busy(false), m_failed(false) {
+    m_process = new QProcess(this);
+    m_process->setProcessChannelMode(QProcess::SeparateChannels);
+    connect(m_process, &QProcess::readyReadStandardOutput, this, &SpeechWorker::onReadyRead);
+    connect(m_process, &QProcess::finished, this, &SpeechWorker::onFinished);
+
+    QSettings settings("AutoWord", "Config");
+    const QString override = settings.value("Tts/WorkerCommand").toString();
+    m_command = override.isEmpty() ? defaultCommand() : QProcess::splitCommand(override);
+}
+
+SpeechWorker::~SpeechWorker() {
+    if (m_process->state() != QProcess::NotRunning) {
+        m_process->closeWriteChannel();
+        if (!m_process->waitForFinished(500)) m_process->kill();
+    }
+}
+
+QStringList SpeechWorker::defaultCommand() {
+#if defined(Q_OS_WIN)
+    return {"powershell", "-NoProfile", "-NonInteractive", "-Command",
+            "[Console]::InputEncoding = [Text.Encoding]::UTF8; "
+            "Add-Type -AssemblyName System.Speech; "
+            "$s = New-Object System.Speech.Synthesis.SpeechSynthesizer; "
+            "while (($line = [Console]::In.ReadLine()) -ne $null) { "
+            "if ($line -eq 'STOP') { $s.SpeakAsyncCancelAll(); continue } "
+            "if ($line.StartsWith('SPEAK ')) { $s.Speak($line.Substring(6)); "
+            "[Console]::Out.WriteLine('DONE'); [Console]::Out.Flush() } }"};
+#elif defined(Q_OS_MACOS)
+    return {"sh", "-c",
+            "while IFS= read -r line; do case \"$line\" in "
+            "\"SPEAK \"*) say -- \"${line#SPEAK }\" >/dev/null 2>&1; echo DONE;; "
+            "esac; done"};
+#else
+    return {"sh", "-c",
+            "while IFS= read -r line; do case \"$line\" in "
+            "\"SPEAK \"*) espeak-ng -- \"${line#SPEAK }\" >/dev/null 2>&1; echo DONE;; "
+            "esac; done"};
+#endif
+}
+
+void SpeechWorker::setCommand(const QStringList& command) {
+    cancel();
+    if (m_process->state() != QProcess::NotRunning) {
+        m_process->kill();
+        m_process->waitForFinished(500);
+    }
+    m_command = command;
+    m_failed = false;
+}
+
+void SpeechWorker::enqueue(const QString& text) {
+    QString line = text;
+    line.replace('\r', ' ').replace('\n', ' ');
+    line = line.trimmed();
+    if (line.isEmpty()) return;
+    m_pending.append(line);
+    if (!m_busy) sendNext();
+}
+
+void SpeechWorker::cancel() {
+    m_pending.clear();
+    if (m_busy && m_process->state() == QProcess::Running) {
+        m_process->write("STOP\n");
+    }
+}
+
+bool SpeechWorker::isBusy() const {
+    return m_busy;
+}
+
+bool SpeechWorker::start() {
+    if (m_process->state() == QProcess::Running) return true;
+    if (m_failed || m_command.isEmpty()) return false;
+
+    m_process->start(m_command.first(), m_command.mid(1));
+    if (!m_process->waitForStarted(3000)) {
+        qWarning() << "SpeechWorker: failed to start" << m_command.first() << m_process->errorString();
+        m_failed = true;
+        return false;
+    }
+    return true;
+}
+
+void SpeechWorker::sendNext() {
+    if (m_pending.isEmpty()) return;
+    if (!start()) {
+        m_pending.clear();
+        return;
+    }
+    m_current = m_pending.takeFirst();
+    m_busy = true;
+    m_process->write("SPEAK " + m_current.toUtf8() + "\n");
+    emit started(m_current);
+}
+
+void SpeechWorker::onReadyRead() {
+    while (m_process->canReadLine()) {
+        const QByteArray line = m_process->readLine().trimmed();
+        if (line != "DONE" || !m_busy) continue;
+        m_busy = false;
+        emit spoken(m_current);
+        m_current.clear();
+        sendNext();
+    }
+}
+
+void SpeechWorker::onFinished() {
+    // Restarted on the next request; a worker that keeps dying is not
+    // restarted in a loop because nothing is pending by then.
+    if (m_busy) qWarning() << "SpeechWorker: worker exited while speaking";
+    m_busy = false;
+    m_current.clear();
+    m_pending.clear();
+}
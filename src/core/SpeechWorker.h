@@ -0,0 +1,51 @@
+#pragma once
+#include <QObject>
+#include <QProcess>
+#include <QStringList>
+
+// A long-lived speech process fed over its stdin, used when Qt TextToSpeech
+// is not available. The protocol is one line per request:
+//
+//   SPEAK <text>   speak text (newlines are replaced by spaces)
+//   STOP           stop the current utterance if the worker can
+//
+// and the worker answers every SPEAK with a DONE line once it has finished or
+// been stopped. Requests are queued here and sent one at a time, so cancel()
+// always drops the queue even when the worker cannot interrupt itself. Any
+// program following the protocol works, which makes a stub easy for tests,
+// e.g. sh -c 'while read -r l; do case "$l" in SPEAK*) echo DONE;; esac; done'.
+class SpeechWorker : public QObject {
+    Q_OBJECT
+
+public:
+    explicit SpeechWorker(QObject *parent = nullptr);
+    ~SpeechWorker();
+
+    // The platform worker: a PowerShell System.Speech loop on Windows, `say`
+    // on macOS and espeak-ng elsewhere. "Tts/WorkerCommand" overrides it.
+    static QStringList defaultCommand();
+
+    // Starts the process if it is not running; requests also start it.
+    bool start();
+    void setCommand(const QStringList& command);
+    void enqueue(const QString& text);
+    void cancel();
+    bool isBusy() const;
+
+signals:
+    // A request was handed to the running worker.
+    void started(const QString& text);
+    void spoken(const QString& text);
+
+private:
+    void sendNext();
+    void onReadyRead();
+    void onFinished();
+
+    QProcess *m_process;
+    QStringList m_command;
+    QStringList m_pending;
+    QString m_current;
+    bool m_busy;
+    bool m_failed;
+};
@@ -0,0 +1,95 @@
+#include "StudyPrefetcher.h"
+#include <QSqlDatabase>
+#include <QDebug>
+#include <utility>
+
+StudyPrefetcher::StudyPrefetcher(QObject *parent)
+    : QObject(parent), m_worker(new QObject), m_generation(0), m_pending(false), m_ready(false) {
+    m_connection = QString("prefetch-%1").arg(quintptr(this), 0, 16);
+    m_worker->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_worker, &QObject::deleteLater);
+    m_thread.start(QThread::LowPriority);
+}
+
+StudyPrefetcher::~StudyPrefetcher() {
+    m_thread.quit();
+    m_thread.wait();
+}
+
+void StudyPrefetcher::request(int bookId, int limit, Mode mode, NewWordOrder order, const QSet<int>& excludeIds) {
+    if (m_pending || m_ready || limit <= 0) return;
+
+    m_pending = true;
+    const int generation = m_generation;
+    const QString connection = m_connection;
+    DueIndex::Cursor cursor = m_dueCursor;
+    QMetaObject::invokeMethod(m_worker, [this, generation, connection, bookId, limit, mode, order,
+                                         excludeIds, cursor]() mutable {
+        QList<Word> words;
+        QList<FsrsCard> cards;
+        {
+            QSqlDatabase db = QSqlDatabase::cloneDatabase(QSqlDatabase::defaultConnection, connection);
+            db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=2000");
+            if (db.open()) {
+                const DatabaseManager& dm = DatabaseManager::instance();
+                QSet<int> taken = excludeIds;
+                if (mode == Mode::AtRisk) {
+                    words = dm.getAtRiskWords(bookId, limit, taken, db);
+                } else {
+                    words = dm.getWordsByIds(dm.getDueWordIds(bookId, limit, taken, &cursor), bookId, db);
+                }
+                for (const Word& w : words) taken.insert(w.id);
+                if (words.size() < limit) {
+                    words += dm.getNewWords(bookId, limit - int(words.size()), order, taken, db);
+                }
+
+                QList<int> ids;
+                for (const Word& w : words) ids.append(w.id);
+                cards = dm.getCards(ids, db);
+                db.close();
+            } else {
+                qWarning() << "StudyPrefetcher: failed to open connection";
+            }
+        }
+        QSqlDatabase::removeDatabase(connection);
+
+        QMetaObject::invokeMethod(this, [this, generation, words, cards, cursor]() {
+            if (generation != m_generation) return;
+            m_pending = false;
+            m_dueCursor = cursor;
+            m_ready = true;
+            m_words = words;
+            m_cards.clear();
+            for (const FsrsCard& card : cards) m_cards.insert(card.wordId, card);
+            emit batchReady();
+        }, Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
+}
+
+void StudyPrefetcher::cancel() {
+    // Fetches run one at a time on the worker, so a new request may start
+    // while the cancelled one finishes; its result is recognised and dropped.
+    m_generation++;
+    m_dueCursor = DueIndex::Cursor();
+    m_pending = false;
+    m_ready = false;
+    m_words.clear();
+    m_cards.clear();
+}
+
+bool StudyPrefetcher::isPending() const {
+    return m_pending;
+}
+
+bool StudyPrefetcher::hasBatch() const {
+    return m_ready;
+}
+
+QList<Word> StudyPrefetcher::takeWords() {
+    m_ready = false;
+    return std::exchange(m_words, {});
+}
+
+QHash<int, FsrsCard> StudyPrefetcher::takeCards() {
+    return std::exchange(m_cards, {});
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QThread>
+#include "Word.h"
+#include "FsrsScheduler.h"
+#include "../db/DatabaseManager.h"
+
+// Fetches the next study batch (words plus their cards) on a worker thread
+// with its own SQLite connection, so a session can continue without waiting
+// on the database. The due walk over the DueIndex runs on the worker too and
+// resumes from where the previous batch of the session stopped.
+class StudyPrefetcher : public QObject {
+    Q_OBJECT
+
+public:
+    enum class Mode {
+        Due,
+        AtRisk
+    };
+
+    explicit StudyPrefetcher(QObject *parent = nullptr);
+    ~StudyPrefetcher();
+
+    // Starts fetching unless a fetch is already running or a batch is ready.
+    void request(int bookId, int limit, Mode mode, NewWordOrder order, const QSet<int>& excludeIds);
+    // Drops any ready batch and ignores the result of a running fetch.
+    void cancel();
+
+    bool isPending() const;
+    bool hasBatch() const;
+    QList<Word> takeWords();
+    QHash<int, FsrsCard> takeCards();
+
+signals:
+    void batchReady();
+
+private:
+    QThread m_thread;
+    QObject *m_worker;
+    QString m_connection;
+    DueIndex::Cursor m_dueCursor;
+    int m_generation;
+    bool m_pending;
+    bool m_ready;
+    QList<Word> m_words;
+    QHash<int, FsrsCard> m_cards;
+};
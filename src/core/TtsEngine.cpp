@@ -1,5 +1,24 @@
 #include "TtsEngine.h"
+#include <QCoreApplication>
 #include <QDebug>
+#include <QSettings>
+#include <QStandardPaths>
+#include <algorithm>
+#include <utility>
+#ifndef HAVE_QT_TTS
+#include "SpeechWorker.h"
+#endif
+#ifdef HAVE_QT_MULTIMEDIA
+#include "AudioPack.h"
+#include <QAudioOutput>
+#include <QBuffer>
+#include <QMediaPlayer>
+#include <QUrl>
+#endif
+#ifdef HAVE_SPEECH_CACHE
+#include "SpeechCache.h"
+#include <QAudioSink>
+#endif
 
 TtsEngine& TtsEngine::instance() {
     static TtsEngine instance;
@@ -7,35 +26,304 @@ TtsEngine& TtsEngine::instance() {
 }
 
 TtsEngine::TtsEngine() {
+    m_clock.start();
+    m_thread.setObjectName("TtsEngine");
+    moveToThread(&m_thread);
+    connect(&m_thread, &QThread::started, this, &TtsEngine::init);
+    // The engine objects must go away on their own thread, before the
+    // application does.
+    connect(qApp, &QCoreApplication::aboutToQuit, this, &TtsEngine::shutdown, Qt::BlockingQueuedConnection);
+    m_thread.start();
+}
+
+TtsEngine::~TtsEngine() {
+    m_thread.quit();
+    m_thread.wait();
+}
+
+void TtsEngine::init() {
+    const qint64 start = m_clock.elapsed();
 #ifdef HAVE_QT_TTS
     m_speech = new QTextToSpeech(this);
-    
-    QList<QVoice> voices = m_speech->availableVoices();
-    for (const QVoice &voice : voices) {
-        if (voice.name().contains("English", Qt::CaseInsensitive) || 
-            voice.name().contains("US", Qt::CaseInsensitive) ||
-            voice.name().contains("UK", Qt::CaseInsensitive)) {
-            m_speech->setVoice(voice);
-            break;
+    connect(m_speech, &QTextToSpeech::stateChanged, this, &TtsEngine::onStateChanged);
+    const qint64 created = m_clock.elapsed();
+
+    // The chosen voice is remembered, so later launches skip the search
+    // whenever the engine's default already is that voice.
+    QSettings settings("AutoWord", "Config");
+    const QString cached = settings.value("Tts/Voice").toString();
+    if (cached.isEmpty() || m_speech->voice().name() != cached) {
+        QList<QVoice> voices = m_speech->availableVoices();
+        auto chosen = std::find_if(voices.cbegin(), voices.cend(), [&cached](const QVoice& voice) {
+            return voice.name() == cached;
+        });
+        if (chosen == voices.cend()) {
+            chosen = std::find_if(voices.cbegin(), voices.cend(), [](const QVoice& voice) {
+                return voice.name().contains("English", Qt::CaseInsensitive) ||
+                       voice.name().contains("US", Qt::CaseInsensitive) ||
+                       voice.name().contains("UK", Qt::CaseInsensitive);
+            });
+        }
+        if (chosen != voices.cend()) {
+            m_speech->setVoice(*chosen);
+            settings.setValue("Tts/Voice", chosen->name());
         }
     }
+    const qint64 voiced = m_clock.elapsed();
+
+    // A silent utterance loads the voice data now instead of on the first card.
+    m_volume = m_speech->volume();
+    m_warmingUp = true;
+    m_speech->setVolume(0.0);
+    m_speech->say("a");
+    qDebug() << "TtsEngine: engine" << created - start << "ms, voice" << voiced - created << "ms,"
+             << m_speech->voice().name();
+#else
+    m_worker = new SpeechWorker(this);
+    connect(m_worker, &SpeechWorker::started, this, &TtsEngine::audioStarted);
+    m_worker->start();
+    qDebug() << "TtsEngine: worker started in" << m_clock.elapsed() - start << "ms";
+#endif
+#ifdef HAVE_SPEECH_CACHE
+    m_cache = new SpeechCache(this);
+    m_cache->setVoice(m_speech->voice());
+    m_buffer = new QBuffer(this);
+#endif
+#ifdef HAVE_QT_MULTIMEDIA
+    m_pack = new AudioPack();
+    m_player = new QMediaPlayer(this);
+    m_output = new QAudioOutput(this);
+    m_player->setAudioOutput(m_output);
+    connect(m_player, &QMediaPlayer::playbackStateChanged, this, [this](QMediaPlayer::PlaybackState state) {
+        if (state == QMediaPlayer::PlayingState) audioStarted();
+    });
+    connect(m_player, &QMediaPlayer::mediaStatusChanged, this, [this](QMediaPlayer::MediaStatus status) {
+        if (status == QMediaPlayer::EndOfMedia) m_packText.clear();
+    });
+    // A clip the backend cannot decode is spoken by synthesis instead.
+    connect(m_player, &QMediaPlayer::errorOccurred, this, [this](QMediaPlayer::Error, const QString& message) {
+        if (m_packText.isEmpty()) return;
+        qWarning() << "TtsEngine: cannot play clip for" << m_packText << message;
+        synthesize(std::exchange(m_packText, QString()));
+    });
+    // Without a configured pack, one installed next to the database is used.
+    QString packPath = QSettings("AutoWord", "Config").value("Tts/AudioPack").toString();
+    if (packPath.isEmpty()) {
+        const QString installed = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)
+                                  + "/pronunciation.awaudio";
+        if (QFile::exists(installed)) packPath = installed;
+    }
+    if (!packPath.isEmpty()) openPack(packPath);
+#endif
+    qDebug() << "TtsEngine: ready" << m_clock.elapsed() << "ms after startup";
+}
+
+void TtsEngine::shutdown() {
+#ifdef HAVE_QT_MULTIMEDIA
+    // The player reads straight from the mapping, so it goes first.
+    delete m_player;
+    m_player = nullptr;
+    delete m_clip;
+    m_clip = nullptr;
+    delete m_pack;
+    m_pack = nullptr;
+#endif
+#ifdef HAVE_SPEECH_CACHE
+    delete m_sink;
+    m_sink = nullptr;
+    delete m_cache;
+    m_cache = nullptr;
+#endif
+#ifdef HAVE_QT_TTS
+    delete m_speech;
+    m_speech = nullptr;
+#else
+    delete m_worker;
+    m_worker = nullptr;
 #endif
+    m_thread.quit();
 }
 
 void TtsEngine::speak(const QString& text) {
+    const qint64 requestedAt = m_clock.elapsed();
+    QMetaObject::invokeMethod(this, [this, text, requestedAt]() { speakNow(text, requestedAt); },
+                              Qt::QueuedConnection);
+}
+
+void TtsEngine::stop() {
+    QMetaObject::invokeMethod(this, [this]() { stopNow(); }, Qt::QueuedConnection);
+}
+
+void TtsEngine::prefetch(const QStringList& texts) {
+#ifdef HAVE_SPEECH_CACHE
+    QMetaObject::invokeMethod(this, [this, texts]() {
+        if (m_cache) m_cache->prefetch(texts);
+    }, Qt::QueuedConnection);
+#else
+    Q_UNUSED(texts);
+#endif
+}
+
+void TtsEngine::setAudioPack(const QString& path) {
+#ifdef HAVE_QT_MULTIMEDIA
+    const Qt::ConnectionType type = QThread::currentThread() == &m_thread ? Qt::DirectConnection
+                                                                          : Qt::BlockingQueuedConnection;
+    QMetaObject::invokeMethod(this, [this, path]() { openPack(path); }, type);
+#else
+    Q_UNUSED(path);
+#endif
+}
+
+QString TtsEngine::audioPack() {
+    QString path;
+#ifdef HAVE_QT_MULTIMEDIA
+    const Qt::ConnectionType type = QThread::currentThread() == &m_thread ? Qt::DirectConnection
+                                                                          : Qt::BlockingQueuedConnection;
+    QMetaObject::invokeMethod(this, [this]() {
+        return m_pack && m_pack->isOpen() ? m_pack->fileName() : QString();
+    }, type, &path);
+#endif
+    return path;
+}
+
+void TtsEngine::speakNow(const QString& text, qint64 requestedAt) {
+    if (m_firstRequestAt < 0) m_firstRequestAt = requestedAt;
+#ifdef HAVE_QT_MULTIMEDIA
+    m_packText.clear();
+    if (m_pack && playPack(text)) return;
+#endif
+    synthesize(text);
+}
+
+void TtsEngine::synthesize(const QString& text) {
+#ifdef HAVE_SPEECH_CACHE
+    if (m_cache && playCached(text)) {
+        audioStarted();
+        return;
+    }
+    // Played live this time; cached for the next.
+    if (m_cache) m_cache->prefetch({text});
+#endif
 #ifdef HAVE_QT_TTS
+    if (!m_speech) return;
+    if (m_warmingUp) {
+        m_warmingUp = false;
+        m_speech->stop();
+        m_speech->setVolume(m_volume);
+    }
     if (m_speech->state() == QTextToSpeech::Speaking) {
         m_speech->stop();
     }
     m_speech->say(text);
 #else
-    QString cmd = QString("powershell -Command \"Add-Type -AssemblyName System.Speech; (New-Object System.Speech.Synthesis.SpeechSynthesizer).Speak('%1');\"").arg(text);
-    QProcess::startDetached(cmd);
+    if (!m_worker) return;
+    m_worker->cancel();
+    m_worker->enqueue(text);
 #endif
 }
 
-void TtsEngine::stop() {
+void TtsEngine::stopNow() {
+#ifdef HAVE_QT_MULTIMEDIA
+    m_packText.clear();
+    if (m_player) m_player->stop();
+#endif
+#ifdef HAVE_SPEECH_CACHE
+    if (m_sink) m_sink->stop();
+#endif
 #ifdef HAVE_QT_TTS
-    m_speech->stop();
+    if (m_speech) m_speech->stop();
+#else
+    if (m_worker) m_worker->cancel();
 #endif
 }
+
+void TtsEngine::audioStarted() {
+    if (m_firstAudioLogged || m_firstRequestAt < 0) return;
+    m_firstAudioLogged = true;
+    const qint64 latency = m_clock.elapsed() - m_firstRequestAt;
+    if (latency > FirstAudioBudgetMs) {
+        qWarning() << "TtsEngine: first audio after" << latency << "ms, budget" << FirstAudioBudgetMs << "ms";
+    } else {
+        qDebug() << "TtsEngine: first audio after" << latency << "ms";
+    }
+}
+
+#ifdef HAVE_QT_TTS
+void TtsEngine::onStateChanged(QTextToSpeech::State state) {
+    if (m_warmingUp && state == QTextToSpeech::Ready) {
+        m_warmingUp = false;
+        m_speech->setVolume(m_volume);
+        qDebug() << "TtsEngine: warm-up done" << m_clock.elapsed() << "ms after startup";
+        return;
+    }
+    if (state == QTextToSpeech::Speaking) audioStarted();
+}
+#endif
+
+#ifdef HAVE_QT_MULTIMEDIA
+void TtsEngine::openPack(const QString& path) {
+    if (!m_pack) return;
+    m_packText.clear();
+    m_player->stop();
+    m_player->setSourceDevice(nullptr);
+    delete m_clip;
+    m_clip = nullptr;
+    m_pack->close();
+    if (!path.isEmpty() && m_pack->open(path)) {
+        qDebug() << "TtsEngine: audio pack" << path << "with" << m_pack->count() << "clips";
+    }
+}
+
+bool TtsEngine::playPack(const QString& text) {
+    const int entry = m_pack->isOpen() ? m_pack->find(text) : -1;
+    if (entry < 0) return false;
+    const QByteArray clip = m_pack->clip(entry);
+    if (clip.isEmpty()) return false;
+
+#ifdef HAVE_QT_TTS
+    if (m_speech && m_speech->state() == QTextToSpeech::Speaking) m_speech->stop();
+#else
+    if (m_worker) m_worker->cancel();
+#endif
+#ifdef HAVE_SPEECH_CACHE
+    if (m_sink) m_sink->stop();
+#endif
+
+    // The buffer wraps the mapped clip, so nothing is copied; the old one is
+    // released only after the player has let go of it.
+    QBuffer *buffer = new QBuffer(this);
+    buffer->setData(clip);
+    buffer->open(QIODevice::ReadOnly);
+    m_player->stop();
+    m_player->setSourceDevice(buffer, QUrl("clip." + m_pack->format()));
+    delete m_clip;
+    m_clip = buffer;
+    m_packText = text;
+    m_player->play();
+    return true;
+}
+#endif
+
+#ifdef HAVE_SPEECH_CACHE
+bool TtsEngine::playCached(const QString& text) {
+    QByteArray pcm;
+    QAudioFormat format;
+    if (!m_cache->lookup(text, pcm, format)) return false;
+
+    if (m_speech->state() == QTextToSpeech::Speaking) m_speech->stop();
+    if (m_sink) {
+        m_sink->stop();
+        if (m_sink->format() != format) {
+            delete m_sink;
+            m_sink = nullptr;
+        }
+    }
+    if (!m_sink) m_sink = new QAudioSink(format, this);
+
+    m_buffer->close();
+    m_buffer->setData(pcm);
+    m_buffer->open(QIODevice::ReadOnly);
+    m_sink->start(m_buffer);
+    return true;
+}
+#endif
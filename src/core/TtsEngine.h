@@ -1,21 +1,89 @@
 #pragma once
 #include <QObject>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QThread>
 #ifdef HAVE_QT_TTS
 #include <QTextToSpeech>
 #endif
-#include <QProcess>
 
+#ifndef HAVE_QT_TTS
+class SpeechWorker;
+#endif
+#ifdef HAVE_SPEECH_CACHE
+class SpeechCache;
+class QAudioSink;
+#endif
+#ifdef HAVE_QT_MULTIMEDIA
+class AudioPack;
+class QAudioOutput;
+class QBuffer;
+class QMediaPlayer;
+#endif
+
+// Lives on a thread of its own: the engine, voice lookup and warm-up run
+// there, and the public calls only post work to it, so the UI never waits
+// on speech. Created at startup so the first card finds it ready.
 class TtsEngine : public QObject {
     Q_OBJECT
 
 public:
+    // First audio later than this after the first request is logged as a warning.
+    static const int FirstAudioBudgetMs = 300;
+
     static TtsEngine& instance();
     void speak(const QString& text);
     void stop();
+    // Synthesizes the texts ahead of time so speak() can play them at once.
+    // Does nothing when the speech cache is not built in.
+    void prefetch(const QStringList& texts);
+    // Recorded clips from this pack are played before anything is
+    // synthesized; an empty path turns the pack off. Needs Qt Multimedia.
+    // Returns once the engine has switched, so the old file is no longer
+    // mapped and may be replaced.
+    void setAudioPack(const QString& path);
+    // The open pack's path, empty if none.
+    QString audioPack();
 
 private:
     TtsEngine();
+    ~TtsEngine();
+    void init();
+    void shutdown();
+    void speakNow(const QString& text, qint64 requestedAt);
+    void synthesize(const QString& text);
+    void stopNow();
+    void audioStarted();
+
+    QThread m_thread;
+    QElapsedTimer m_clock;
+    qint64 m_firstRequestAt = -1;
+    bool m_firstAudioLogged = false;
 #ifdef HAVE_QT_TTS
-    QTextToSpeech *m_speech;
+    void onStateChanged(QTextToSpeech::State state);
+
+    QTextToSpeech *m_speech = nullptr;
+    double m_volume = 1.0;
+    bool m_warmingUp = false;
+#else
+    SpeechWorker *m_worker = nullptr;
+#endif
+#ifdef HAVE_QT_MULTIMEDIA
+    void openPack(const QString& path);
+    bool playPack(const QString& text);
+
+    AudioPack *m_pack = nullptr;
+    QMediaPlayer *m_player = nullptr;
+    QAudioOutput *m_output = nullptr;
+    QBuffer *m_clip = nullptr;
+    // Spoken from the pack right now; synthesized instead if the clip fails.
+    QString m_packText;
+#endif
+#ifdef HAVE_SPEECH_CACHE
+    bool playCached(const QString& text);
+
+    SpeechCache *m_cache = nullptr;
+    QAudioSink *m_sink = nullptr;
+    QBuffer *m_buffer = nullptr;
 #endif
 };
@@ -13,8 +13,15 @@ struct Word {
     int bookId = 0;
     bool isFavorite = false;
     QDateTime createdAt;
+    qint64 sourceHash = 0;
 
     bool isValid() const {
         return !spelling.isEmpty() && !definition.isEmpty();
     }
 };
+
+struct WordDigest {
+    int id = -1;
+    QString spelling;
+    qint64 sourceHash = 0;
+};
@@ -6,13 +6,37 @@ WordModel::WordModel(QObject *parent) : QAbstractListModel(parent) {
 
 int WordModel::rowCount(const QModelIndex &parent) const {
     if (parent.isValid()) return 0;
+    if (m_pack) return m_packAllRows ? m_pack->count() : m_packRows.count();
     return m_words.count();
 }
 
 QVariant WordModel::data(const QModelIndex &index, int role) const {
-    if (!index.isValid() || index.row() >= m_words.count())
+    if (!index.isValid() || index.row() >= rowCount())
         return QVariant();
 
+    if (m_pack) {
+        int record = packRecord(index.row());
+        switch (role) {
+        case IdRole:
+            return -1;
+        case SpellingRole:
+            return m_pack->field(record, DictionaryPack::Spelling);
+        case Qt::DisplayRole:
+            return QString("%1  -  %2").arg(m_pack->field(record, DictionaryPack::Spelling),
+                                            m_pack->field(record, DictionaryPack::Definition));
+        case PhoneticRole:
+            return m_pack->field(record, DictionaryPack::Phonetic);
+        case DefinitionRole:
+            return m_pack->field(record, DictionaryPack::Definition);
+        case ExampleRole:
+            return m_pack->field(record, DictionaryPack::Example);
+        case FavoriteRole:
+            return false;
+        default:
+            return QVariant();
+        }
+    }
+
     const Word &word = m_words[index.row()];
 
     switch (role) {
@@ -48,14 +72,54 @@ QHash<int, QByteArray> WordModel::roleNames() const {
 
 void WordModel::loadWords(int bookId) {
     beginResetModel();
+    m_pack.reset();
+    m_packRows.clear();
+    m_packAllRows = false;
     m_allWords = DatabaseManager::instance().getAllWords(bookId);
     m_words = m_allWords;
     endResetModel();
 }
 
+bool WordModel::loadPack(const QString &packPath) {
+    auto pack = std::make_unique<DictionaryPack>();
+    if (!pack->open(packPath)) return false;
+
+    beginResetModel();
+    m_words.clear();
+    m_allWords.clear();
+    m_pack = std::move(pack);
+    // Rows map straight onto the pack's sorted index until a filter or a
+    // shuffle needs a list of their own.
+    m_packRows.clear();
+    m_packAllRows = true;
+    endResetModel();
+    return true;
+}
+
+int WordModel::packRecord(int row) const {
+    return m_packAllRows ? m_pack->recordAt(row) : m_packRows[row];
+}
+
+bool WordModel::isPackLoaded() const {
+    return m_pack != nullptr;
+}
+
 void WordModel::setFilter(const QString &text) {
     beginResetModel();
-    if (text.isEmpty()) {
+    if (m_pack) {
+        QByteArray key = text.trimmed().toLower().toUtf8();
+        std::string_view needle(key.constData(), size_t(key.size()));
+        m_packRows.clear();
+        m_packAllRows = key.isEmpty();
+        if (!m_packAllRows) {
+            for (int i = 0; i < m_pack->count(); ++i) {
+                int record = m_pack->recordAt(i);
+                if (m_pack->rawField(record, DictionaryPack::Key).find(needle) != std::string_view::npos) {
+                    m_packRows.append(record);
+                }
+            }
+        }
+    } else if (text.isEmpty()) {
         m_words = m_allWords;
     } else {
         m_words.clear();
@@ -69,6 +133,7 @@ void WordModel::setFilter(const QString &text) {
 }
 
 void WordModel::addWord(const Word& word) {
+    if (m_pack) return;
     if (DatabaseManager::instance().addWord(word)) {
         beginInsertRows(QModelIndex(), m_words.count(), m_words.count());
         m_words.append(word);
@@ -78,7 +143,7 @@ void WordModel::addWord(const Word& word) {
 }
 
 void WordModel::toggleFavorite(int row) {
-    if (row < 0 || row >= m_words.count()) return;
+    if (m_pack || row < 0 || row >= m_words.count()) return;
     
     Word& word = m_words[row];
     bool newStatus = !word.isFavorite;
@@ -91,7 +156,27 @@ void WordModel::toggleFavorite(int row) {
 
 void WordModel::sortWords(SortOrder order) {
     beginResetModel();
-    if (order == Alphabetical) {
+    if (m_pack) {
+        // The index is already in key order, so all rows sorted alphabetically
+        // need no list; only a shuffle has to spell them out.
+        if (order == Alphabetical && (m_packAllRows || m_packRows.count() == m_pack->count())) {
+            m_packRows.clear();
+            m_packAllRows = true;
+        } else if (order == Alphabetical) {
+            std::sort(m_packRows.begin(), m_packRows.end(), [this](int a, int b) {
+                return m_pack->rawField(a, DictionaryPack::Key) < m_pack->rawField(b, DictionaryPack::Key);
+            });
+        } else if (order == Random) {
+            if (m_packAllRows) {
+                m_packRows.reserve(m_pack->count());
+                for (int i = 0; i < m_pack->count(); ++i) {
+                    m_packRows.append(m_pack->recordAt(i));
+                }
+                m_packAllRows = false;
+            }
+            std::random_shuffle(m_packRows.begin(), m_packRows.end());
+        }
+    } else if (order == Alphabetical) {
         std::sort(m_words.begin(), m_words.end(), [](const Word& a, const Word& b) {
             return a.spelling.compare(b.spelling, Qt::CaseInsensitive) < 0;
         });
@@ -1,6 +1,8 @@
 #pragma once
 #include <QAbstractListModel>
 #include "Word.h"
+#include "DictionaryPack.h"
+#include <memory>
 
 class WordModel : public QAbstractListModel {
     Q_OBJECT
@@ -23,6 +25,8 @@ public:
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
 
     void loadWords(int bookId = -1);
+    bool loadPack(const QString &packPath);
+    bool isPackLoaded() const;
     void addWord(const Word& word);
     void toggleFavorite(int row);
 
@@ -37,6 +41,11 @@ public:
     void setFilter(const QString &text);
 
 private:
+    int packRecord(int row) const;
+
     QList<Word> m_words;     // Displayed words
     QList<Word> m_allWords;  // All loaded words
+    std::unique_ptr<DictionaryPack> m_pack;
+    QList<int> m_packRows;   // Displayed pack records, unless m_packAllRows
+    bool m_packAllRows = false; // Every record in index order; m_packRows is unused
 };
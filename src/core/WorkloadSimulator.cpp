@@ -0,0 +1,212 @@
+#include "WorkloadSimulator.h"
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace {
+
+// Probabilities of Hard, Good and Easy among successful reviews, and of a
+// lapse during a same-day learning step.
+const double kHardShare = 0.15;
+const double kGoodShare = 0.75;
+const double kStepFailRate = 0.1;
+const int kMaxStepsPerDay = 8;
+
+// Shares of Again, Hard, Good and Easy as the first rating of a new card,
+// used until the collection has enough first reviews of its own. These are
+// the defaults of the reference FSRS simulator.
+const double kDefaultFirstRatingShares[4] = {0.24, 0.094, 0.495, 0.171};
+
+}
+
+WorkloadSimulator::WorkloadSimulator(const FsrsScheduler& scheduler)
+    : m_scheduler(scheduler), m_newCards(0), m_newPerDay(20),
+      m_reviewSeconds(8.0), m_learnSeconds(20.0), m_seed(5489) {
+    std::copy(kDefaultFirstRatingShares, kDefaultFirstRatingShares + 4, m_firstRatingShares);
+}
+
+void WorkloadSimulator::setCards(const QList<FsrsCard>& cards, const QDateTime& now) {
+    m_lanes.clear();
+    m_lanes.reserve(cards.size());
+    for (const FsrsCard& card : cards) {
+        if (card.state == 0) continue;
+        Lane lane;
+        lane.stability = card.stability;
+        lane.difficulty = card.difficulty;
+        lane.state = card.state;
+        lane.lastDay = card.lastReview.isValid() ? -int(std::max<qint64>(0, card.lastReview.daysTo(now))) : 0;
+        lane.dueDay = card.due.isValid() ? int(std::max<qint64>(0, now.daysTo(card.due))) : 0;
+        m_lanes.append(lane);
+    }
+    m_newCards = int(cards.size() - m_lanes.size());
+}
+
+void WorkloadSimulator::setNewCards(int count, int perDay) {
+    m_newCards += std::max(0, count);
+    m_newPerDay = std::max(0, perDay);
+}
+
+void WorkloadSimulator::setFirstRatingCounts(const QList<int>& counts) {
+    std::copy(kDefaultFirstRatingShares, kDefaultFirstRatingShares + 4, m_firstRatingShares);
+    int total = 0;
+    for (int i = 0; i < 4 && i < counts.size(); ++i) total += std::max(0, counts[i]);
+    if (total < kMinFirstRatings) return;
+    for (int i = 0; i < 4; ++i) {
+        m_firstRatingShares[i] = i < counts.size() ? double(std::max(0, counts[i])) / total : 0.0;
+    }
+}
+
+void WorkloadSimulator::setCosts(double reviewSeconds, double learnSeconds) {
+    m_reviewSeconds = reviewSeconds;
+    m_learnSeconds = learnSeconds;
+}
+
+void WorkloadSimulator::setSeed(quint64 seed) {
+    m_seed = seed;
+}
+
+QList<WorkloadDay> WorkloadSimulator::simulate(int days, const std::atomic_bool *stop) const {
+    if (days <= 0) return {};
+
+    const int threads = std::max(1, QThread::idealThreadCount());
+    std::vector<QList<WorkloadDay>> partial(threads);
+    std::vector<char> finished(threads, 0);
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    for (int t = 0; t < threads; ++t) {
+        QList<Lane> lanes;
+        lanes.reserve(m_lanes.size() / threads + 1);
+        for (qsizetype i = t; i < m_lanes.size(); i += threads) lanes.append(m_lanes[i]);
+        const quint64 seed = m_seed ^ (quint64(t + 1) * 0x9E3779B97F4A7C15ULL);
+        pool.start([this, t, threads, days, seed, stop, lanes, &partial, &finished]() {
+            finished[t] = simulateLanes(lanes, t, threads, days, seed, stop, partial[t]);
+        });
+    }
+    pool.waitForDone();
+    if (std::find(finished.begin(), finished.end(), 0) != finished.end()) return {};
+
+    QList<WorkloadDay> total(days);
+    for (const QList<WorkloadDay>& part : partial) {
+        for (int d = 0; d < days && d < part.size(); ++d) {
+            total[d].reviews += part[d].reviews;
+            total[d].learned += part[d].learned;
+            total[d].lapses += part[d].lapses;
+            total[d].minutes += part[d].minutes;
+        }
+    }
+    return total;
+}
+
+bool WorkloadSimulator::simulateLanes(QList<Lane> lanes, int newOffset, int newStride, int days,
+                                      quint64 seed, const std::atomic_bool *stop, QList<WorkloadDay>& out) const {
+    out = QList<WorkloadDay>(days);
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::discrete_distribution<int> firstRating(m_firstRatingShares, m_firstRatingShares + 4);
+
+    // Cards are bucketed by due day, so each day only touches what is due.
+    std::vector<std::vector<int>> buckets(days);
+    for (int i = 0; i < lanes.size(); ++i) {
+        if (lanes[i].dueDay < days) buckets[lanes[i].dueDay].push_back(i);
+    }
+
+    FsrsCardBatch batch;
+    QList<int> ratings;
+    std::vector<int> active;
+    std::vector<int> pending;
+    int nextNew = newOffset;
+
+    // Schedules the active lanes with the sampled ratings. Lanes that finish
+    // the day get their next due day; lanes still in a learning step go to pending.
+    auto run = [&](int day) {
+        const qsizetype n = qsizetype(active.size());
+        batch.resize(n);
+        for (qsizetype j = 0; j < n; ++j) {
+            const Lane& lane = lanes[active[j]];
+            batch.stability[j] = lane.stability;
+            batch.difficulty[j] = lane.difficulty;
+            batch.state[j] = lane.state;
+            batch.elapsedDays[j] = day - lane.lastDay;
+            batch.scheduledDays[j] = 0;
+            batch.reps[j] = 0;
+            batch.lapses[j] = 0;
+            batch.dueSecs[j] = -1;
+        }
+        m_scheduler.scheduleBatch(batch, ratings);
+        for (qsizetype j = 0; j < n; ++j) {
+            const int i = active[j];
+            Lane& lane = lanes[i];
+            lane.stability = batch.stability[j];
+            lane.difficulty = batch.difficulty[j];
+            lane.state = batch.state[j];
+            lane.lastDay = day;
+            if (batch.dueSecs[j] == 0) {
+                lane.dueDay = day + batch.scheduledDays[j];
+                if (lane.dueDay < days) buckets[lane.dueDay].push_back(i);
+            } else {
+                pending.push_back(i);
+            }
+        }
+    };
+
+    for (int day = 0; day < days; ++day) {
+        if (stop && *stop) return false;
+        WorkloadDay& stats = out[day];
+        pending.clear();
+
+        active.swap(buckets[day]);
+        std::vector<int>().swap(buckets[day]);
+        ratings.resize(qsizetype(active.size()));
+        for (size_t j = 0; j < active.size(); ++j) {
+            const Lane& lane = lanes[active[j]];
+            const double r = lane.stability > 0
+                ? FsrsScheduler::retrievability(day - lane.lastDay, lane.stability) : 0.0;
+            const double u = uniform(rng);
+            int rating = FsrsRating::Again;
+            if (u < r) {
+                rating = u < r * kHardShare ? FsrsRating::Hard
+                       : u < r * (kHardShare + kGoodShare) ? FsrsRating::Good
+                                                           : FsrsRating::Easy;
+            }
+            ratings[qsizetype(j)] = rating;
+            stats.lapses += rating == FsrsRating::Again && lane.state == 2;
+        }
+        stats.reviews += int(active.size());
+        stats.minutes += active.size() * m_reviewSeconds / 60.0;
+        run(day);
+
+        active.clear();
+        while (m_newPerDay > 0 && nextNew < m_newCards && nextNew / m_newPerDay <= day) {
+            lanes.append(Lane{0.0, 0.0, 0, day, day});
+            active.push_back(int(lanes.size() - 1));
+            nextNew += newStride;
+        }
+        ratings.resize(qsizetype(active.size()));
+        for (qsizetype j = 0; j < ratings.size(); ++j) {
+            ratings[j] = FsrsRating::Again + firstRating(rng);
+        }
+        stats.learned += int(active.size());
+        stats.minutes += active.size() * m_learnSeconds / 60.0;
+        run(day);
+
+        // Same-day learning and relearning steps.
+        for (int step = 0; step < kMaxStepsPerDay && !pending.empty(); ++step) {
+            active.swap(pending);
+            pending.clear();
+            ratings.resize(qsizetype(active.size()));
+            for (qsizetype j = 0; j < ratings.size(); ++j) {
+                ratings[j] = uniform(rng) < kStepFailRate ? FsrsRating::Again : FsrsRating::Good;
+            }
+            stats.reviews += int(active.size());
+            stats.minutes += active.size() * m_reviewSeconds / 60.0;
+            run(day);
+        }
+        for (int i : pending) {
+            lanes[i].dueDay = day + 1;
+            if (day + 1 < days) buckets[day + 1].push_back(i);
+        }
+    }
+    return true;
+}
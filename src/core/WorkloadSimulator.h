@@ -0,0 +1,58 @@
+#pragma once
+#include "FsrsScheduler.h"
+#include <QDateTime>
+#include <QList>
+#include <atomic>
+
+struct WorkloadDay {
+    int reviews = 0;
+    int learned = 0;
+    int lapses = 0;
+    double minutes = 0.0;
+};
+
+// Monte Carlo projection of future daily review load. Each simulated review
+// samples recall from the card's predicted retrievability and is rescheduled
+// with FsrsScheduler::scheduleBatch(). Cards are split across threads, each
+// with its own RNG stream, and the per-day counts are summed at the end.
+class WorkloadSimulator {
+public:
+    explicit WorkloadSimulator(const FsrsScheduler& scheduler = FsrsScheduler());
+
+    // Cards in state 0 join the new-card queue instead of the review queue.
+    void setCards(const QList<FsrsCard>& cards, const QDateTime& now = QDateTime::currentDateTime());
+    void setNewCards(int count, int perDay);
+    // How often each rating 1..4 was given to a new card, e.g. from
+    // DatabaseManager::getFirstRatingCounts(). Below kMinFirstRatings in
+    // total the default shares are kept.
+    void setFirstRatingCounts(const QList<int>& counts);
+    void setCosts(double reviewSeconds, double learnSeconds);
+    void setSeed(quint64 seed);
+
+    // Returns an empty list if `stop` is set before the run is done; it is
+    // checked once per simulated day on every thread.
+    QList<WorkloadDay> simulate(int days, const std::atomic_bool *stop = nullptr) const;
+
+    static constexpr int kMinFirstRatings = 100;
+
+private:
+    struct Lane {
+        double stability;
+        double difficulty;
+        int state;
+        int lastDay;
+        int dueDay;
+    };
+
+    bool simulateLanes(QList<Lane> lanes, int newOffset, int newStride, int days,
+                       quint64 seed, const std::atomic_bool *stop, QList<WorkloadDay>& out) const;
+
+    FsrsScheduler m_scheduler;
+    QList<Lane> m_lanes;
+    int m_newCards;
+    int m_newPerDay;
+    double m_firstRatingShares[4];
+    double m_reviewSeconds;
+    double m_learnSeconds;
+    quint64 m_seed;
+};
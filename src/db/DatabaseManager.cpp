@@ -7,6 +7,45 @@
 #include <QDir>
 #include <QDateTime>
 #include <QTime>
+#include <QHash>
+#include <QRandomGenerator>
+#include <algorithm>
+#include <cmath>
+
+#ifdef HAVE_SQLITE3
+#include <QSqlDriver>
+#include <sqlite3.h>
+
+namespace {
+
+QDateTime sqlDateTime(sqlite3_value *value) {
+    const unsigned char *text = sqlite3_value_text(value);
+    if (!text) return QDateTime();
+    return QDateTime::fromString(QString::fromUtf8(reinterpret_cast<const char *>(text)), Qt::ISODateWithMs);
+}
+
+void sqlRetrievability(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    const double stability = sqlite3_value_double(argv[0]);
+    const QDateTime lastReview = sqlDateTime(argv[1]);
+    const QDateTime now = argc > 2 ? sqlDateTime(argv[2]) : QDateTime::currentDateTime();
+    if (stability <= 0 || !lastReview.isValid() || !now.isValid()) {
+        sqlite3_result_null(context);
+        return;
+    }
+    const double elapsed = std::max(0.0, lastReview.msecsTo(now) / 86400000.0);
+    sqlite3_result_double(context, FsrsScheduler::retrievability(elapsed, stability));
+}
+
+// Efraimidis-Spirakis key -ln(u) / w: the rows with the smallest keys form
+// a weighted sample without replacement.
+void sqlSampleKey(sqlite3_context *context, int, sqlite3_value **argv) {
+    const double weight = sqlite3_value_double(argv[0]);
+    const double u = 1.0 - QRandomGenerator::global()->generateDouble();
+    sqlite3_result_double(context, weight > 0 ? -std::log(u) / weight : HUGE_VAL);
+}
+
+}
+#endif
 
 DatabaseManager& DatabaseManager::instance() {
     static DatabaseManager instance;
@@ -30,7 +69,10 @@ bool DatabaseManager::connect(const QString& path) {
         return false;
     }
     qDebug() << "Database: connection ok";
-    return initTables();
+    if (!initTables()) return false;
+    registerSqlFunctions();
+    m_dueIndex.load(m_db);
+    return true;
 }
 
 bool DatabaseManager::initTables() {
@@ -44,26 +86,41 @@ bool DatabaseManager::initTables() {
         qCritical() << "Error creating books table:" << query.lastError();
         return false;
     }
+    // Set for books kept in step with a watched file (see FolderSync).
+    if (!m_db.record("books").contains("source_path")) {
+        query.exec("ALTER TABLE books ADD COLUMN source_path TEXT");
+    }
+    query.exec("CREATE UNIQUE INDEX IF NOT EXISTS idx_books_source ON books(source_path) WHERE source_path IS NOT NULL");
 
-    if (!query.exec("CREATE TABLE IF NOT EXISTS words ("
+    if (!query.exec("CREATE TABLE IF NOT EXISTS lexemes ("
                     "id INTEGER PRIMARY KEY AUTOINCREMENT, "
-                    "book_id INTEGER DEFAULT 0, "
                     "spelling TEXT NOT NULL, "
                     "phonetic TEXT, "
-                    "definition TEXT, "
+                    "definition TEXT NOT NULL DEFAULT '', "
                     "example TEXT, "
                     "tags TEXT, "
                     "is_favorite INTEGER DEFAULT 0, "
-                    "created_at DATETIME DEFAULT CURRENT_TIMESTAMP, "
-                    "FOREIGN KEY(book_id) REFERENCES books(id)"
+                    "created_at DATETIME DEFAULT CURRENT_TIMESTAMP"
                     ")")) {
-        qCritical() << "Error creating words table:" << query.lastError();
+        qCritical() << "Error creating lexemes table:" << query.lastError();
         return false;
     }
-    
-    if (!m_db.record("words").contains("book_id")) {
-        query.exec("ALTER TABLE words ADD COLUMN book_id INTEGER DEFAULT 0");
+    query.exec("CREATE UNIQUE INDEX IF NOT EXISTS idx_lexemes_key ON lexemes(spelling, definition)");
+
+    if (!query.exec("CREATE TABLE IF NOT EXISTS book_words ("
+                    "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+                    "book_id INTEGER NOT NULL DEFAULT 0, "
+                    "lexeme_id INTEGER NOT NULL, "
+                    "source_hash INTEGER DEFAULT 0, "
+                    "created_at DATETIME DEFAULT CURRENT_TIMESTAMP, "
+                    "UNIQUE(book_id, lexeme_id), "
+                    "FOREIGN KEY(book_id) REFERENCES books(id), "
+                    "FOREIGN KEY(lexeme_id) REFERENCES lexemes(id)"
+                    ")")) {
+        qCritical() << "Error creating book_words table:" << query.lastError();
+        return false;
     }
+    query.exec("CREATE INDEX IF NOT EXISTS idx_book_words_lexeme ON book_words(lexeme_id)");
 
     if (!query.exec("CREATE TABLE IF NOT EXISTS cards ("
                     "id INTEGER PRIMARY KEY AUTOINCREMENT, "
@@ -77,24 +134,249 @@ bool DatabaseManager::initTables() {
                     "reps INTEGER DEFAULT 0, "
                     "lapses INTEGER DEFAULT 0, "
                     "last_review DATETIME, "
-                    "FOREIGN KEY(word_id) REFERENCES words(id)"
+                    "FOREIGN KEY(word_id) REFERENCES lexemes(id)"
                     ")")) {
         qCritical() << "Error creating cards table:" << query.lastError();
         return false;
     }
 
+    if (!query.exec("CREATE TABLE IF NOT EXISTS review_logs ("
+                    "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+                    "word_id INTEGER NOT NULL, "
+                    "rating INTEGER NOT NULL, "
+                    "state INTEGER DEFAULT 0, "
+                    "elapsed_days INTEGER DEFAULT 0, "
+                    "scheduled_days INTEGER DEFAULT 0, "
+                    "reviewed_at DATETIME, "
+                    "kind INTEGER DEFAULT 0, "
+                    "FOREIGN KEY(word_id) REFERENCES lexemes(id)"
+                    ")")) {
+        qCritical() << "Error creating review_logs table:" << query.lastError();
+        return false;
+    }
+    if (!m_db.record("review_logs").contains("kind")) {
+        query.exec("ALTER TABLE review_logs ADD COLUMN kind INTEGER DEFAULT 0");
+    }
+    query.exec("CREATE INDEX IF NOT EXISTS idx_review_logs_word ON review_logs(word_id, reviewed_at)");
+
+    // Written by NeighborIndexer; book_id -1 holds the lists for all words.
+    if (!query.exec("CREATE TABLE IF NOT EXISTS word_neighbors ("
+                    "book_id INTEGER NOT NULL, "
+                    "word_id INTEGER NOT NULL, "
+                    "neighbor_id INTEGER NOT NULL, "
+                    "rank INTEGER NOT NULL, "
+                    "PRIMARY KEY(book_id, word_id, rank)"
+                    ") WITHOUT ROWID")) {
+        qCritical() << "Error creating word_neighbors table:" << query.lastError();
+        return false;
+    }
+    // One row per indexed book: the word count the lists were built from.
+    if (!query.exec("CREATE TABLE IF NOT EXISTS neighbor_index ("
+                    "book_id INTEGER PRIMARY KEY, "
+                    "word_count INTEGER NOT NULL, "
+                    "indexed_at DATETIME"
+                    ")")) {
+        qCritical() << "Error creating neighbor_index table:" << query.lastError();
+        return false;
+    }
+
+    if (query.exec("SELECT type FROM sqlite_master WHERE name = 'words'") && query.next()
+        && query.value(0).toString() == "table") {
+        if (!migrateWordsToLexemes()) return false;
+    }
+
+    // Cards belong to lexemes, so a word shared by several books is scheduled once.
+    query.exec("CREATE UNIQUE INDEX IF NOT EXISTS idx_cards_word ON cards(word_id)");
+
+    if (!initNewWordSampling()) return false;
+
+    if (!query.exec("CREATE VIEW IF NOT EXISTS words AS "
+                    "SELECT l.id AS id, bw.book_id AS book_id, l.spelling AS spelling, "
+                    "l.phonetic AS phonetic, l.definition AS definition, l.example AS example, "
+                    "l.tags AS tags, l.is_favorite AS is_favorite, bw.created_at AS created_at, "
+                    "bw.source_hash AS source_hash "
+                    "FROM book_words bw JOIN lexemes l ON l.id = bw.lexeme_id")) {
+        qCritical() << "Error creating words view:" << query.lastError();
+        return false;
+    }
+
     return true;
 }
 
+bool DatabaseManager::initNewWordSampling() {
+    // getNewWords() reads partial indexes that hold only unseen words. `seen`
+    // mirrors whether the lexeme has a card past state 0 and is kept in step
+    // by the triggers below, whoever writes the card; `sample_key` is a
+    // random key drawn once when the row is added.
+    QSqlQuery query;
+    for (const char *table : {"lexemes", "book_words"}) {
+        if (m_db.record(table).contains("sample_key")) continue;
+        const QString name = table;
+        if (!query.exec(QString("ALTER TABLE %1 ADD COLUMN seen INTEGER NOT NULL DEFAULT 0").arg(name))
+            || !query.exec(QString("ALTER TABLE %1 ADD COLUMN sample_key INTEGER").arg(name))
+            || !query.exec(QString("UPDATE %1 SET sample_key = random()").arg(name))
+            || !query.exec(QString("UPDATE %1 SET seen = 1 WHERE %2 IN (SELECT word_id FROM cards WHERE state <> 0)")
+                           .arg(name, name == "lexemes" ? "id" : "lexeme_id"))) {
+            qCritical() << "Error adding new-word sampling columns:" << query.lastError();
+            return false;
+        }
+    }
+
+    const char *statements[] = {
+        "CREATE INDEX IF NOT EXISTS idx_lexemes_unseen_order ON lexemes(id) WHERE seen = 0",
+        "CREATE INDEX IF NOT EXISTS idx_lexemes_unseen_key ON lexemes(sample_key) WHERE seen = 0",
+        "CREATE INDEX IF NOT EXISTS idx_book_words_unseen_order ON book_words(book_id, lexeme_id) WHERE seen = 0",
+        "CREATE INDEX IF NOT EXISTS idx_book_words_unseen_key ON book_words(book_id, sample_key) WHERE seen = 0",
+
+        "CREATE TRIGGER IF NOT EXISTS cards_seen_insert AFTER INSERT ON cards "
+        "WHEN NEW.state <> 0 BEGIN "
+        "UPDATE lexemes SET seen = 1 WHERE id = NEW.word_id; "
+        "UPDATE book_words SET seen = 1 WHERE lexeme_id = NEW.word_id; "
+        "END",
+
+        "CREATE TRIGGER IF NOT EXISTS cards_seen_update AFTER UPDATE OF state, word_id ON cards "
+        "WHEN OLD.word_id <> NEW.word_id OR (OLD.state = 0) <> (NEW.state = 0) BEGIN "
+        "UPDATE lexemes SET seen = 0 WHERE id = OLD.word_id; "
+        "UPDATE book_words SET seen = 0 WHERE lexeme_id = OLD.word_id; "
+        "UPDATE lexemes SET seen = NEW.state <> 0 WHERE id = NEW.word_id; "
+        "UPDATE book_words SET seen = NEW.state <> 0 WHERE lexeme_id = NEW.word_id; "
+        "END",
+
+        "CREATE TRIGGER IF NOT EXISTS cards_seen_delete AFTER DELETE ON cards "
+        "WHEN OLD.state <> 0 BEGIN "
+        "UPDATE lexemes SET seen = 0 WHERE id = OLD.word_id; "
+        "UPDATE book_words SET seen = 0 WHERE lexeme_id = OLD.word_id; "
+        "END",
+
+        // A word already studied elsewhere joins a book as seen.
+        "CREATE TRIGGER IF NOT EXISTS book_words_seen AFTER INSERT ON book_words "
+        "WHEN EXISTS (SELECT 1 FROM cards WHERE word_id = NEW.lexeme_id AND state <> 0) BEGIN "
+        "UPDATE book_words SET seen = 1 WHERE id = NEW.id; "
+        "END"
+    };
+    for (const char *sql : statements) {
+        if (!query.exec(sql)) {
+            qCritical() << "Error setting up new-word sampling:" << query.lastError();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DatabaseManager::migrateWordsToLexemes() {
+    QSqlQuery query;
+    if (!m_db.record("words").contains("book_id")) {
+        query.exec("ALTER TABLE words ADD COLUMN book_id INTEGER DEFAULT 0");
+    }
+    if (!m_db.record("words").contains("source_hash")) {
+        query.exec("ALTER TABLE words ADD COLUMN source_hash INTEGER DEFAULT 0");
+    }
+
+    if (!m_db.transaction()) {
+        qCritical() << "Failed to begin migration:" << m_db.lastError();
+        return false;
+    }
+
+    const char *steps[] = {
+        "INSERT OR IGNORE INTO lexemes (spelling, phonetic, definition, example, tags, created_at) "
+        "SELECT spelling, phonetic, COALESCE(definition, ''), example, tags, created_at FROM words ORDER BY id",
+
+        "CREATE TEMP TABLE word_map AS "
+        "SELECT w.id AS old_id, l.id AS lexeme_id, COALESCE(w.book_id, 0) AS book_id, "
+        "w.source_hash AS source_hash, w.created_at AS created_at, w.is_favorite AS is_favorite "
+        "FROM words w JOIN lexemes l ON l.spelling = w.spelling AND l.definition = COALESCE(w.definition, '')",
+
+        "INSERT OR IGNORE INTO book_words (book_id, lexeme_id, source_hash, created_at) "
+        "SELECT book_id, lexeme_id, source_hash, created_at FROM word_map ORDER BY old_id",
+
+        "UPDATE lexemes SET is_favorite = 1 "
+        "WHERE id IN (SELECT lexeme_id FROM word_map WHERE is_favorite)",
+
+        "UPDATE cards SET word_id = (SELECT lexeme_id FROM word_map WHERE old_id = cards.word_id)",
+
+        "DELETE FROM cards WHERE word_id IS NULL",
+
+        // Duplicates of a lexeme keep the card with the most review history.
+        "DELETE FROM cards WHERE EXISTS (SELECT 1 FROM cards c2 WHERE c2.word_id = cards.word_id "
+        "AND (c2.reps > cards.reps OR (c2.reps = cards.reps AND c2.id < cards.id)))",
+
+        "DROP TABLE word_map",
+        "DROP TABLE words"
+    };
+    for (const char *sql : steps) {
+        if (!query.exec(sql)) {
+            qCritical() << "Error migrating words table:" << query.lastError();
+            m_db.rollback();
+            return false;
+        }
+    }
+    return m_db.commit();
+}
+
 QSqlDatabase DatabaseManager::database() const {
     return m_db;
 }
 
-int DatabaseManager::createBook(const QString& name) {
+bool DatabaseManager::registerSqlFunctions() {
+#ifdef HAVE_SQLITE3
+    QVariant handle = m_db.driver()->handle();
+    if (!handle.isValid() || qstrcmp(handle.typeName(), "sqlite3*") != 0) return false;
+    sqlite3 *db = *static_cast<sqlite3 **>(handle.data());
+    if (!db) return false;
+
+    // The build only enables this for a Qt using the system SQLite; still
+    // refuse a driver that reports a different library than the one linked.
+    QSqlQuery version(m_db);
+    if (!version.exec("SELECT sqlite_source_id()") || !version.next()
+        || version.value(0).toString() != QString::fromLatin1(sqlite3_sourceid())) {
+        qWarning() << "Database: driver SQLite differs from the linked one, SQL functions disabled";
+        return false;
+    }
+
+    const int flags = SQLITE_UTF8 | SQLITE_DETERMINISTIC;
+    bool ok = sqlite3_create_function(db, "retrievability", 2, SQLITE_UTF8, nullptr,
+                                      sqlRetrievability, nullptr, nullptr) == SQLITE_OK
+           && sqlite3_create_function(db, "retrievability", 3, flags, nullptr,
+                                      sqlRetrievability, nullptr, nullptr) == SQLITE_OK
+           && sqlite3_create_function(db, "sample_key", 1, SQLITE_UTF8, nullptr,
+                                      sqlSampleKey, nullptr, nullptr) == SQLITE_OK;
+    m_hasSqlFunctions = ok;
+    return ok;
+#else
+    return false;
+#endif
+}
+
+QString DatabaseManager::retrievabilitySql(const QString& stability, const QString& lastReview, const QString& now,
+                                           const QSqlDatabase& db) const {
+    if (m_hasSqlFunctions && (!db.isValid() || db.connectionName() == m_db.connectionName())) {
+        return QString("retrievability(%1, %2, %3)").arg(stability, lastReview, now);
+    }
+    // Same curve as FsrsScheduler::retrievability() in plain SQL.
+    return QString("(1.0 / (1.0 + MAX(julianday(%3) - julianday(%2), 0) / (81.0 * %1)))")
+        .arg(stability, lastReview, now);
+}
+
+QString DatabaseManager::sampleKeySql(const QString& weight) const {
+    if (m_hasSqlFunctions) {
+        return QString("sample_key(%1)").arg(weight);
+    }
+    // Without the function: a uniform draw scaled by weight, which favours
+    // heavy rows the same way but not in exact proportion.
+    return QString("((ABS(RANDOM()) % 1000000 + 1) / (%1))").arg(weight);
+}
+
+const DueIndex& DatabaseManager::dueIndex() const {
+    return m_dueIndex;
+}
+
+int DatabaseManager::createBook(const QString& name, bool *created) {
+    if (created) *created = false;
     QSqlQuery query;
     query.prepare("INSERT INTO books (name) VALUES (:name)");
     query.bindValue(":name", name);
     if (query.exec()) {
+        if (created) *created = true;
         return query.lastInsertId().toInt();
     }
     query.prepare("SELECT id FROM books WHERE name = :name");
@@ -105,6 +387,43 @@ int DatabaseManager::createBook(const QString& name) {
     return 0; 
 }
 
+int DatabaseManager::getSourceBook(const QString& sourcePath, const QString& name, const QSqlDatabase& db) {
+    QSqlQuery query(db);
+    query.prepare("SELECT id FROM books WHERE source_path = :path");
+    query.bindValue(":path", sourcePath);
+    if (query.exec() && query.next()) {
+        return query.value(0).toInt();
+    }
+
+    // Never adopt a book the user made: a taken name gets a numbered suffix.
+    query.prepare("INSERT INTO books (name, source_path) VALUES (:name, :path)");
+    for (int n = 1; n < 100; ++n) {
+        query.bindValue(":name", n == 1 ? name : QString("%1 (%2)").arg(name).arg(n));
+        query.bindValue(":path", sourcePath);
+        if (query.exec()) {
+            return query.lastInsertId().toInt();
+        }
+    }
+    qWarning() << "Failed to create book for" << sourcePath << query.lastError();
+    return 0;
+}
+
+int DatabaseManager::detachSourceBook(const QString& sourcePath, const QSqlDatabase& db) {
+    QSqlQuery query(db);
+    query.prepare("SELECT id FROM books WHERE source_path = :path");
+    query.bindValue(":path", sourcePath);
+    if (!query.exec() || !query.next()) return 0;
+    const int bookId = query.value(0).toInt();
+
+    query.prepare("UPDATE books SET source_path = NULL WHERE id = :id");
+    query.bindValue(":id", bookId);
+    if (!query.exec()) {
+        qWarning() << "Failed to unlink book from" << sourcePath << query.lastError();
+        return 0;
+    }
+    return bookId;
+}
+
 QList<Book> DatabaseManager::getAllBooks() const {
     QList<Book> books;
     QSqlQuery query("SELECT * FROM books ORDER BY created_at DESC");
@@ -115,7 +434,7 @@ QList<Book> DatabaseManager::getAllBooks() const {
         b.createdAt = query.value("created_at").toDateTime();
         
         QSqlQuery countQuery;
-        countQuery.prepare("SELECT COUNT(*) FROM words WHERE book_id = :id");
+        countQuery.prepare("SELECT COUNT(*) FROM book_words WHERE book_id = :id");
         countQuery.bindValue(":id", b.id);
         if (countQuery.exec() && countQuery.next()) {
             b.count = countQuery.value(0).toInt();
@@ -127,7 +446,7 @@ QList<Book> DatabaseManager::getAllBooks() const {
 }
 
 int DatabaseManager::getUncategorizedWordCount() const {
-    QSqlQuery query("SELECT COUNT(*) FROM words WHERE book_id = 0 OR book_id IS NULL");
+    QSqlQuery query("SELECT COUNT(*) FROM book_words WHERE book_id = 0");
     if (query.next()) {
         return query.value(0).toInt();
     }
@@ -136,17 +455,49 @@ int DatabaseManager::getUncategorizedWordCount() const {
 
 bool DatabaseManager::deleteBook(int bookId) {
     QSqlQuery query;
-    query.prepare("DELETE FROM words WHERE book_id = :id");
+    if (!m_db.transaction()) return false;
+
+    QList<int> lexemeIds;
+    query.prepare("SELECT lexeme_id FROM book_words WHERE book_id = :id");
+    query.bindValue(":id", bookId);
+    if (query.exec()) {
+        while (query.next()) lexemeIds.append(query.value(0).toInt());
+    }
+
+    QList<int> removedCards;
+    query.prepare("DELETE FROM book_words WHERE book_id = :id");
+    query.bindValue(":id", bookId);
+    if (!query.exec() || !pruneLexemes(lexemeIds, removedCards)) {
+        m_db.rollback();
+        return false;
+    }
+
+    query.prepare("DELETE FROM word_neighbors WHERE book_id = :id");
+    query.bindValue(":id", bookId);
+    if (!query.exec()) {
+        m_db.rollback();
+        return false;
+    }
+    query.prepare("DELETE FROM neighbor_index WHERE book_id = :id");
     query.bindValue(":id", bookId);
-    if (!query.exec()) return false;
+    if (!query.exec()) {
+        m_db.rollback();
+        return false;
+    }
 
     query.prepare("DELETE FROM books WHERE id = :id");
     query.bindValue(":id", bookId);
-    return query.exec();
+    if (!query.exec() || !m_db.commit()) {
+        m_db.rollback();
+        return false;
+    }
+    for (int id : lexemeIds) m_dueIndex.removeMember(id, bookId);
+    for (int id : removedCards) m_dueIndex.remove(id);
+    return true;
 }
 
 int DatabaseManager::getTotalWordCount() const {
-    QSqlQuery query("SELECT COUNT(*) FROM words");
+    QSqlQuery query("SELECT COUNT(*) FROM lexemes");
     if (query.next()) return query.value(0).toInt();
     return 0;
 }
@@ -160,11 +511,7 @@ int DatabaseManager::getLearnedWordCount() const {
 
 int DatabaseManager::getDueWordCount() const {
 
-    QSqlQuery query;
-    query.prepare("SELECT COUNT(*) FROM cards WHERE due <= :now");
-    query.bindValue(":now", QDateTime::currentDateTime());
-    if (query.exec() && query.next()) return query.value(0).toInt();
-    return 0;
+    return m_dueIndex.dueCount(QDateTime::currentDateTime());
 }
 
 QMap<QString, int> DatabaseManager::getReviewHistory() {
@@ -202,35 +549,265 @@ QMap<QString, int> DatabaseManager::getReviewHistory() {
     return history;
 }
 
-bool DatabaseManager::deleteWord(int wordId) {
+bool DatabaseManager::deleteWord(int wordId, int bookId) {
+    if (!m_db.transaction()) return false;
+
     QSqlQuery query;
-    query.prepare("DELETE FROM words WHERE id = :id");
+    if (bookId == -1) {
+        query.prepare("DELETE FROM book_words WHERE lexeme_id = :id");
+    } else {
+        query.prepare("DELETE FROM book_words WHERE lexeme_id = :id AND book_id = :book_id");
+        query.bindValue(":book_id", bookId);
+    }
     query.bindValue(":id", wordId);
-    return query.exec();
+    QList<int> removedCards;
+    if (!query.exec() || !pruneLexemes({wordId}, removedCards) || !m_db.commit()) {
+        m_db.rollback();
+        return false;
+    }
+    if (bookId == -1) {
+        m_dueIndex.removeMembers(wordId);
+    } else {
+        m_dueIndex.removeMember(wordId, bookId);
+    }
+    for (int id : removedCards) m_dueIndex.remove(id);
+    return true;
+}
+
+bool DatabaseManager::pruneLexemes(const QList<int>& lexemeIds, QList<int>& removedCards,
+                                   const QSqlDatabase& db) {
+    QSqlQuery removeCard(db);
+    removeCard.prepare("DELETE FROM cards WHERE word_id = :id "
+                       "AND NOT EXISTS (SELECT 1 FROM book_words WHERE lexeme_id = :member_id)");
+    QSqlQuery removeLogs(db);
+    removeLogs.prepare("DELETE FROM review_logs WHERE word_id = :id "
+                       "AND NOT EXISTS (SELECT 1 FROM book_words WHERE lexeme_id = :member_id)");
+    QSqlQuery removeLexeme(db);
+    removeLexeme.prepare("DELETE FROM lexemes WHERE id = :id "
+                         "AND NOT EXISTS (SELECT 1 FROM book_words WHERE lexeme_id = :member_id)");
+    for (int id : lexemeIds) {
+        removeCard.bindValue(":id", id);
+        removeCard.bindValue(":member_id", id);
+        removeLogs.bindValue(":id", id);
+        removeLogs.bindValue(":member_id", id);
+        removeLexeme.bindValue(":id", id);
+        removeLexeme.bindValue(":member_id", id);
+        if (!removeCard.exec() || !removeLogs.exec() || !removeLexeme.exec()) {
+            qWarning() << "Failed to prune lexeme:" << removeLexeme.lastError();
+            return false;
+        }
+        if (removeCard.numRowsAffected() > 0) removedCards.append(id);
+    }
+    return true;
+}
+
+namespace {
+
+// Prepared statements for writing a word as a shared lexeme plus a book
+// membership. Lexemes are keyed by (spelling, definition).
+class LexemeWriter {
+public:
+    explicit LexemeWriter(const QSqlDatabase& db = QSqlDatabase())
+        : m_insert(db), m_select(db), m_member(db) {
+        m_insert.prepare("INSERT OR IGNORE INTO lexemes (spelling, phonetic, definition, example, tags, is_favorite, "
+                         "sample_key) "
+                         "VALUES (:spelling, :phonetic, :definition, :example, :tags, :is_favorite, random())");
+        m_select.prepare("SELECT id FROM lexemes WHERE spelling = :spelling AND definition = :definition");
+        m_member.prepare("INSERT INTO book_words (book_id, lexeme_id, source_hash, sample_key) "
+                         "VALUES (:book_id, :lexeme_id, :source_hash, random()) "
+                         "ON CONFLICT(book_id, lexeme_id) DO UPDATE SET source_hash = excluded.source_hash");
+    }
+
+    int lexemeId(const Word& word) {
+        const QString definition = word.definition.isNull() ? QString("") : word.definition;
+        m_insert.bindValue(":spelling", word.spelling);
+        m_insert.bindValue(":phonetic", word.phonetic);
+        m_insert.bindValue(":definition", definition);
+        m_insert.bindValue(":example", word.example);
+        m_insert.bindValue(":tags", word.tags.join(";"));
+        m_insert.bindValue(":is_favorite", word.isFavorite);
+        if (!m_insert.exec()) {
+            qWarning() << "Failed to add lexeme:" << m_insert.lastError();
+            return -1;
+        }
+        if (m_insert.numRowsAffected() > 0) return m_insert.lastInsertId().toInt();
+
+        m_select.bindValue(":spelling", word.spelling);
+        m_select.bindValue(":definition", definition);
+        if (!m_select.exec() || !m_select.next()) return -1;
+        int id = m_select.value(0).toInt();
+        m_select.finish();
+        return id;
+    }
+
+    bool addToBook(int lexemeId, const Word& word) {
+        m_member.bindValue(":book_id", word.bookId);
+        m_member.bindValue(":lexeme_id", lexemeId);
+        m_member.bindValue(":source_hash", word.sourceHash);
+        if (!m_member.exec()) {
+            qWarning() << "Failed to add word to book:" << m_member.lastError();
+            return false;
+        }
+        return true;
+    }
+
+    int write(const Word& word) {
+        int id = lexemeId(word);
+        if (id < 0 || !addToBook(id, word)) return -1;
+        return id;
+    }
+
+private:
+    QSqlQuery m_insert;
+    QSqlQuery m_select;
+    QSqlQuery m_member;
+};
+
 }
 
 bool DatabaseManager::addWord(const Word& word) {
-    QSqlQuery query;
-    query.prepare("INSERT INTO words (book_id, spelling, phonetic, definition, example, tags, is_favorite) "
-                  "VALUES (:book_id, :spelling, :phonetic, :definition, :example, :tags, :is_favorite)");
-    query.bindValue(":book_id", word.bookId);
-    query.bindValue(":spelling", word.spelling);
-    query.bindValue(":phonetic", word.phonetic);
-    query.bindValue(":definition", word.definition);
-    query.bindValue(":example", word.example);
-    query.bindValue(":tags", word.tags.join(";"));
-    query.bindValue(":is_favorite", word.isFavorite);
+    if (!m_db.transaction()) return false;
+    LexemeWriter writer;
+    const int id = writer.write(word);
+    if (id < 0) {
+        m_db.rollback();
+        return false;
+    }
+    if (!m_db.commit()) return false;
+    m_dueIndex.addMember(id, word.bookId);
+    return true;
+}
 
-    if (!query.exec()) {
-        qWarning() << "Failed to add word:" << query.lastError();
+bool DatabaseManager::addWords(QList<Word>& words, const QSqlDatabase& db) {
+    if (words.isEmpty()) return true;
+    QSqlDatabase conn = db.isValid() ? db : m_db;
+    if (!conn.transaction()) {
+        qWarning() << "Failed to begin transaction:" << conn.lastError();
         return false;
     }
+
+    LexemeWriter writer(conn);
+    for (Word& word : words) {
+        word.id = writer.write(word);
+        if (word.id < 0) {
+            conn.rollback();
+            return false;
+        }
+    }
+    if (!conn.commit()) return false;
+    for (const Word& word : words) m_dueIndex.addMember(word.id, word.bookId);
+    return true;
+}
+
+QList<WordDigest> DatabaseManager::getWordDigests(int bookId, const QSqlDatabase& db) const {
+    QList<WordDigest> digests;
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare("SELECT id, spelling, source_hash FROM words WHERE book_id = :book_id ORDER BY id");
+    query.bindValue(":book_id", bookId);
+    if (query.exec()) {
+        while (query.next()) {
+            WordDigest d;
+            d.id = query.value(0).toInt();
+            d.spelling = query.value(1).toString();
+            d.sourceHash = query.value(2).toLongLong();
+            digests.append(d);
+        }
+    }
+    return digests;
+}
+
+bool DatabaseManager::applyWordDiff(int bookId, QList<Word>& inserted, const QList<Word>& updated,
+                                    const QList<int>& deletedIds, const QSqlDatabase& db) {
+    QSqlDatabase conn = db.isValid() ? db : m_db;
+    if (!conn.transaction()) {
+        qWarning() << "Failed to begin transaction:" << conn.lastError();
+        return false;
+    }
+
+    LexemeWriter writer(conn);
+    for (Word& word : inserted) {
+        word.id = writer.write(word);
+        if (word.id < 0) {
+            conn.rollback();
+            return false;
+        }
+    }
+
+    // An edited record may now resolve to a different lexeme; the membership
+    // moves to it and the old lexeme's card follows if nothing else uses it.
+    QList<int> candidates = deletedIds;
+    QList<QPair<int, int>> movedCards;
+    QList<QPair<int, int>> movedMembers;
+    QSqlQuery refresh(conn);
+    refresh.prepare("UPDATE lexemes SET phonetic = :phonetic, example = :example, tags = :tags WHERE id = :id");
+    QSqlQuery leave(conn);
+    leave.prepare("DELETE FROM book_words WHERE book_id = :book_id AND lexeme_id = :id");
+    QSqlQuery moveCard(conn);
+    moveCard.prepare("UPDATE cards SET word_id = :new_id WHERE word_id = :old_id "
+                     "AND NOT EXISTS (SELECT 1 FROM cards WHERE word_id = :new_card_id) "
+                     "AND NOT EXISTS (SELECT 1 FROM book_words WHERE lexeme_id = :old_member_id)");
+    for (const Word& word : updated) {
+        int id = writer.lexemeId(word);
+        bool ok = id >= 0;
+        if (ok && id == word.id) {
+            refresh.bindValue(":phonetic", word.phonetic);
+            refresh.bindValue(":example", word.example);
+            refresh.bindValue(":tags", word.tags.join(";"));
+            refresh.bindValue(":id", id);
+            ok = refresh.exec() && writer.addToBook(id, word);
+        } else if (ok) {
+            leave.bindValue(":book_id", bookId);
+            leave.bindValue(":id", word.id);
+            moveCard.bindValue(":new_id", id);
+            moveCard.bindValue(":old_id", word.id);
+            moveCard.bindValue(":new_card_id", id);
+            moveCard.bindValue(":old_member_id", word.id);
+            ok = writer.addToBook(id, word) && leave.exec() && moveCard.exec();
+            if (ok && moveCard.numRowsAffected() > 0) movedCards.append({word.id, id});
+            movedMembers.append({word.id, id});
+            candidates.append(word.id);
+        }
+        if (!ok) {
+            qWarning() << "Failed to update word:" << word.spelling;
+            conn.rollback();
+            return false;
+        }
+    }
+
+    for (int id : deletedIds) {
+        leave.bindValue(":book_id", bookId);
+        leave.bindValue(":id", id);
+        if (!leave.exec()) {
+            qWarning() << "Failed to delete word:" << leave.lastError();
+            conn.rollback();
+            return false;
+        }
+    }
+
+    QList<int> removedCards;
+    if (!pruneLexemes(candidates, removedCards, conn) || !conn.commit()) {
+        conn.rollback();
+        return false;
+    }
+    for (const Word& word : inserted) m_dueIndex.addMember(word.id, word.bookId);
+    for (const QPair<int, int>& move : movedMembers) {
+        m_dueIndex.removeMember(move.first, bookId);
+        m_dueIndex.addMember(move.second, bookId);
+    }
+    for (int id : deletedIds) m_dueIndex.removeMember(id, bookId);
+    for (const QPair<int, int>& move : movedCards) {
+        QDateTime due = m_dueIndex.dueOf(move.first);
+        m_dueIndex.remove(move.first);
+        m_dueIndex.update(move.second, due);
+    }
+    for (int id : removedCards) m_dueIndex.remove(id);
     return true;
 }
 
 bool DatabaseManager::setFavorite(int wordId, bool favorite) {
     QSqlQuery query;
-    query.prepare("UPDATE words SET is_favorite = :fav WHERE id = :id");
+    query.prepare("UPDATE lexemes SET is_favorite = :fav WHERE id = :id");
     query.bindValue(":fav", favorite);
     query.bindValue(":id", wordId);
     return query.exec();
@@ -241,6 +818,8 @@ QList<Word> DatabaseManager::getAllWords(int bookId) const {
     QString sql = "SELECT * FROM words";
     if (bookId != -1) {
         sql += QString(" WHERE book_id = %1").arg(bookId);
+    } else {
+        sql += " GROUP BY id";
     }
     sql += " ORDER BY spelling ASC";
     
@@ -262,18 +841,143 @@ QList<Word> DatabaseManager::getAllWords(int bookId) const {
 }
 
 QList<Word> DatabaseManager::getDueWords(int bookId, int limit) const {
+    // Due order comes from the in-memory index; SQLite only resolves the
+    // rows for the ids it hands out.
+    return getWordsByIds(getDueWordIds(bookId, limit), bookId);
+}
+
+QList<int> DatabaseManager::getDueWordIds(int bookId, int limit, const QSet<int>& excludeIds,
+                                          DueIndex::Cursor *cursor) const {
+    return m_dueIndex.nextDue(limit, QDateTime::currentDateTime(), bookId, cursor, [&excludeIds](int id) {
+        return !excludeIds.contains(id);
+    });
+}
+
+QList<Word> DatabaseManager::getWordsByIds(const QList<int>& ids, int bookId, const QSqlDatabase& db) const {
     QList<Word> words;
-    QString sql = "SELECT w.* FROM words w JOIN cards c ON w.id = c.word_id WHERE c.due <= :now";
+    if (ids.isEmpty()) return words;
+
+    QStringList idList;
+    for (int id : ids) idList.append(QString::number(id));
+    QString sql = QString("SELECT * FROM words WHERE id IN (%1)").arg(idList.join(','));
     if (bookId != -1) {
-        sql += QString(" AND w.book_id = %1").arg(bookId);
+        sql += QString(" AND book_id = %1").arg(bookId);
     }
-    sql += " ORDER BY c.due ASC LIMIT :limit";
-    
+    sql += " GROUP BY id";
+
+    QHash<int, Word> found;
+    QSqlQuery query(sql, db);
+    while (query.next()) {
+        Word w;
+        w.id = query.value("id").toInt();
+        w.bookId = query.value("book_id").toInt();
+        w.spelling = query.value("spelling").toString();
+        w.phonetic = query.value("phonetic").toString();
+        w.definition = query.value("definition").toString();
+        w.example = query.value("example").toString();
+        w.tags = query.value("tags").toString().split(';', Qt::SkipEmptyParts);
+        w.isFavorite = query.value("is_favorite").toBool();
+        w.createdAt = query.value("created_at").toDateTime();
+        found.insert(w.id, w);
+    }
+    for (int id : ids) {
+        auto it = found.constFind(id);
+        if (it != found.constEnd()) words.append(it.value());
+    }
+    return words;
+}
+
+QList<FsrsCard> DatabaseManager::getCards(const QList<int>& wordIds, const QSqlDatabase& db) const {
+    QList<FsrsCard> cards;
+    if (wordIds.isEmpty()) return cards;
+
+    QStringList idList;
+    for (int id : wordIds) idList.append(QString::number(id));
+    QSqlQuery query(QString("SELECT * FROM cards WHERE word_id IN (%1)").arg(idList.join(',')), db);
+    while (query.next()) {
+        FsrsCard card;
+        card.id = query.value("id").toInt();
+        card.wordId = query.value("word_id").toInt();
+        card.state = query.value("state").toInt();
+        card.due = query.value("due").toDateTime();
+        card.stability = query.value("stability").toDouble();
+        card.difficulty = query.value("difficulty").toDouble();
+        card.elapsedDays = query.value("elapsed_days").toInt();
+        card.scheduledDays = query.value("scheduled_days").toInt();
+        card.reps = query.value("reps").toInt();
+        card.lapses = query.value("lapses").toInt();
+        card.lastReview = query.value("last_review").toDateTime();
+        cards.append(card);
+    }
+    return cards;
+}
+
+QList<Word> DatabaseManager::getTestWords(int bookId, int count) const {
+    QList<Word> words;
+    if (count <= 0) return words;
+
+    // Unseen words weigh 1; difficulty, lapses and a low retrievability add
+    // up to 2, 5 and 3 more.
+    const QString weight = QString("1.0 + COALESCE(c.difficulty, 0) / 5.0 + MIN(COALESCE(c.lapses, 0), 5) "
+                                   "+ CASE WHEN c.state = 2 AND c.stability > 0 AND c.last_review IS NOT NULL "
+                                   "THEN 3.0 * (1.0 - %1) ELSE 0 END")
+        .arg(retrievabilitySql("c.stability", "c.last_review", ":now"));
+
+    QString sql = "SELECT w.* FROM words w LEFT JOIN cards c ON c.word_id = w.id";
+    if (bookId != -1) {
+        sql += QString(" WHERE w.book_id = %1").arg(bookId);
+    } else {
+        sql += " GROUP BY w.id";
+    }
+    sql += QString(" ORDER BY %1 LIMIT :limit").arg(sampleKeySql(weight));
+
     QSqlQuery query;
+    query.setForwardOnly(true);
+    query.prepare(sql);
+    query.bindValue(":now", QDateTime::currentDateTime());
+    query.bindValue(":limit", count);
+    if (query.exec()) {
+        while (query.next()) {
+            Word w;
+            w.id = query.value("id").toInt();
+            w.bookId = query.value("book_id").toInt();
+            w.spelling = query.value("spelling").toString();
+            w.phonetic = query.value("phonetic").toString();
+            w.definition = query.value("definition").toString();
+            w.example = query.value("example").toString();
+            w.tags = query.value("tags").toString().split(';', Qt::SkipEmptyParts);
+            w.isFavorite = query.value("is_favorite").toBool();
+            w.createdAt = query.value("created_at").toDateTime();
+            words.append(w);
+        }
+    } else {
+        qWarning() << "Failed to sample test words:" << query.lastError();
+    }
+    return words;
+}
+
+QList<Word> DatabaseManager::getAtRiskWords(int bookId, int limit, const QSet<int>& excludeIds,
+                                            const QSqlDatabase& db) const {
+    QList<Word> words;
+    QString sql = "SELECT w.* FROM words w JOIN cards c ON w.id = c.word_id "
+                  "WHERE c.state = 2 AND c.stability > 0 AND c.last_review IS NOT NULL";
+    if (!excludeIds.isEmpty()) {
+        QStringList idList;
+        for (int id : excludeIds) idList.append(QString::number(id));
+        sql += QString(" AND w.id NOT IN (%1)").arg(idList.join(','));
+    }
+    if (bookId != -1) {
+        sql += QString(" AND w.book_id = %1").arg(bookId);
+    } else {
+        sql += " GROUP BY w.id";
+    }
+    sql += QString(" ORDER BY %1 ASC LIMIT :limit").arg(retrievabilitySql("c.stability", "c.last_review", ":now", db));
+
+    QSqlQuery query(db);
     query.prepare(sql);
     query.bindValue(":now", QDateTime::currentDateTime());
     query.bindValue(":limit", limit);
-    
+
     if (query.exec()) {
         while (query.next()) {
             Word w;
@@ -292,6 +996,96 @@ QList<Word> DatabaseManager::getDueWords(int bookId, int limit) const {
     return words;
 }
 
+QHash<int, QList<int>> DatabaseManager::getWordNeighbors(int bookId) const {
+    QHash<int, QList<int>> neighbors;
+    QSqlQuery query;
+    query.setForwardOnly(true);
+    query.prepare("SELECT word_id, neighbor_id FROM word_neighbors WHERE book_id = :book_id "
+                  "ORDER BY word_id, rank");
+    query.bindValue(":book_id", bookId);
+    if (query.exec()) {
+        while (query.next()) {
+            neighbors[query.value(0).toInt()].append(query.value(1).toInt());
+        }
+    }
+    return neighbors;
+}
+
+bool DatabaseManager::hasFreshWordNeighbors(int bookId) const {
+    // Lists are rebuilt when the book gained or lost words since indexing;
+    // stale entries for removed words are skipped by the readers meanwhile.
+    QSqlQuery query;
+    query.prepare("SELECT word_count FROM neighbor_index WHERE book_id = :book_id");
+    query.bindValue(":book_id", bookId);
+    if (!query.exec() || !query.next()) return false;
+    const int indexed = query.value(0).toInt();
+
+    if (bookId == -1) {
+        query.prepare("SELECT COUNT(*) FROM lexemes");
+    } else {
+        query.prepare("SELECT COUNT(*) FROM book_words WHERE book_id = :book_id");
+        query.bindValue(":book_id", bookId);
+    }
+    if (!query.exec() || !query.next()) return false;
+    return indexed == query.value(0).toInt();
+}
+
+QList<Word> DatabaseManager::getNewWords(int bookId, int limit, NewWordOrder order, const QSet<int>& excludeIds,
+                                         const QSqlDatabase& db) const {
+    // One walk along a partial index of unseen words, so learned words are
+    // never read and the cost is the rows returned plus any excluded ones
+    // passed over. Random order takes the lowest sample keys: the keys are
+    // uniform and independent, so every set of unseen words of that size is
+    // equally likely. The same words stay in front until they are studied.
+    QList<Word> words;
+    if (limit <= 0) return words;
+
+    QStringList excluded;
+    for (int id : excludeIds) excluded.append(QString::number(id));
+    const bool random = order == NewWordOrder::Random;
+
+    QString sql;
+    if (bookId != -1) {
+        sql = QString("SELECT l.id, bw.book_id, l.spelling, l.phonetic, l.definition, l.example, l.tags, "
+                      "l.is_favorite, l.created_at FROM book_words bw JOIN lexemes l ON l.id = bw.lexeme_id "
+                      "WHERE bw.book_id = :book_id AND bw.seen = 0 %1 ORDER BY bw.%2 LIMIT :limit")
+              .arg(excluded.isEmpty() ? QString() : QString("AND bw.lexeme_id NOT IN (%1)").arg(excluded.join(',')),
+                   QString(random ? "sample_key" : "lexeme_id"));
+    } else {
+        sql = QString("SELECT l.id, (SELECT book_id FROM book_words WHERE lexeme_id = l.id LIMIT 1), "
+                      "l.spelling, l.phonetic, l.definition, l.example, l.tags, l.is_favorite, l.created_at "
+                      "FROM lexemes l INDEXED BY %1 WHERE l.seen = 0 %2 ORDER BY l.%3 LIMIT :limit")
+              // Without the hint, id order is read off the table itself.
+              .arg(QString(random ? "idx_lexemes_unseen_key" : "idx_lexemes_unseen_order"),
+                   excluded.isEmpty() ? QString() : QString("AND l.id NOT IN (%1)").arg(excluded.join(',')),
+                   QString(random ? "sample_key" : "id"));
+    }
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare(sql);
+    if (bookId != -1) query.bindValue(":book_id", bookId);
+    query.bindValue(":limit", limit);
+    if (!query.exec()) {
+        qWarning() << "Failed to read new words:" << query.lastError();
+        return words;
+    }
+    while (query.next()) {
+        Word w;
+        w.id = query.value(0).toInt();
+        w.bookId = query.value(1).toInt();
+        w.spelling = query.value(2).toString();
+        w.phonetic = query.value(3).toString();
+        w.definition = query.value(4).toString();
+        w.example = query.value(5).toString();
+        w.tags = query.value(6).toString().split(';', Qt::SkipEmptyParts);
+        w.isFavorite = query.value(7).toBool();
+        w.createdAt = query.value(8).toDateTime();
+        words.append(w);
+    }
+    return words;
+}
+
 FsrsCard DatabaseManager::getCard(int wordId) {
     FsrsCard card;
     card.wordId = wordId;
@@ -320,10 +1114,37 @@ FsrsCard DatabaseManager::getCard(int wordId) {
         
         card.id = insert.lastInsertId().toInt();
         card.due = QDateTime::currentDateTime();
+        m_dueIndex.update(wordId, card.due);
     }
     return card;
 }
 
+QList<FsrsCard> DatabaseManager::getAllCards(const QSqlDatabase& db) const {
+    QList<FsrsCard> cards;
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT id, word_id, state, due, stability, difficulty, elapsed_days, "
+                    "scheduled_days, reps, lapses, last_review FROM cards")) {
+        return cards;
+    }
+    while (query.next()) {
+        FsrsCard card;
+        card.id = query.value(0).toInt();
+        card.wordId = query.value(1).toInt();
+        card.state = query.value(2).toInt();
+        card.due = query.value(3).toDateTime();
+        card.stability = query.value(4).toDouble();
+        card.difficulty = query.value(5).toDouble();
+        card.elapsedDays = query.value(6).toInt();
+        card.scheduledDays = query.value(7).toInt();
+        card.reps = query.value(8).toInt();
+        card.lapses = query.value(9).toInt();
+        card.lastReview = query.value(10).toDateTime();
+        cards.append(card);
+    }
+    return cards;
+}
+
 bool DatabaseManager::updateCard(const FsrsCard& card) {
     QSqlQuery query;
     query.prepare("UPDATE cards SET state=:state, due=:due, stability=:stability, "
@@ -345,5 +1166,184 @@ bool DatabaseManager::updateCard(const FsrsCard& card) {
         qCritical() << "Error updating card:" << query.lastError();
         return false;
     }
+    m_dueIndex.update(card.wordId, card.due);
     return true;
 }
+
+bool DatabaseManager::updateCards(const QList<FsrsCard>& cards) {
+    if (cards.isEmpty()) return true;
+    if (!m_db.transaction()) {
+        qWarning() << "Failed to begin transaction:" << m_db.lastError();
+        return false;
+    }
+    if (!writeCards(cards)) {
+        m_db.rollback();
+        return false;
+    }
+    if (!m_db.commit()) return false;
+    for (const FsrsCard& card : cards) {
+        if (m_dueIndex.contains(card.wordId)) m_dueIndex.update(card.wordId, card.due);
+    }
+    return true;
+}
+
+bool DatabaseManager::writeCards(const QList<FsrsCard>& cards) {
+    // Keyed by word_id so replayed histories need no card id lookup.
+    QSqlQuery query;
+    query.prepare("UPDATE cards SET state=:state, due=:due, stability=:stability, "
+                  "difficulty=:difficulty, elapsed_days=:elapsed, scheduled_days=:scheduled, "
+                  "reps=:reps, lapses=:lapses, last_review=:last WHERE word_id=:word_id");
+    for (const FsrsCard& card : cards) {
+        query.bindValue(":state", card.state);
+        query.bindValue(":due", card.due);
+        query.bindValue(":stability", card.stability);
+        query.bindValue(":difficulty", card.difficulty);
+        query.bindValue(":elapsed", card.elapsedDays);
+        query.bindValue(":scheduled", card.scheduledDays);
+        query.bindValue(":reps", card.reps);
+        query.bindValue(":lapses", card.lapses);
+        query.bindValue(":last", card.lastReview);
+        query.bindValue(":word_id", card.wordId);
+        if (!query.exec()) {
+            qCritical() << "Error updating card:" << query.lastError();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DatabaseManager::addCards(QList<FsrsCard>& cards, const QSqlDatabase& db) {
+    if (cards.isEmpty()) return true;
+    QSqlDatabase conn = db.isValid() ? db : m_db;
+    if (!conn.transaction()) {
+        qWarning() << "Failed to begin transaction:" << conn.lastError();
+        return false;
+    }
+
+    QSqlQuery query(conn);
+    query.prepare("INSERT OR IGNORE INTO cards (word_id, state, due, stability, difficulty, elapsed_days, "
+                  "scheduled_days, reps, lapses, last_review) "
+                  "VALUES (:word_id, :state, :due, :stability, :difficulty, :elapsed, "
+                  ":scheduled, :reps, :lapses, :last)");
+    for (FsrsCard& card : cards) {
+        query.bindValue(":word_id", card.wordId);
+        query.bindValue(":state", card.state);
+        query.bindValue(":due", card.due);
+        query.bindValue(":stability", card.stability);
+        query.bindValue(":difficulty", card.difficulty);
+        query.bindValue(":elapsed", card.elapsedDays);
+        query.bindValue(":scheduled", card.scheduledDays);
+        query.bindValue(":reps", card.reps);
+        query.bindValue(":lapses", card.lapses);
+        query.bindValue(":last", card.lastReview);
+        if (!query.exec()) {
+            qCritical() << "Error adding card:" << query.lastError();
+            conn.rollback();
+            return false;
+        }
+        // A lexeme shared with another book keeps the card it already has.
+        card.id = query.numRowsAffected() > 0 ? query.lastInsertId().toInt() : -1;
+    }
+    if (!conn.commit()) return false;
+    for (const FsrsCard& card : cards) {
+        if (card.id >= 0) m_dueIndex.update(card.wordId, card.due);
+    }
+    return true;
+}
+
+bool DatabaseManager::addReviewLog(const ReviewLog& log) {
+    QList<ReviewLog> logs{log};
+    return addReviewLogs(logs);
+}
+
+bool DatabaseManager::addReviewLogs(QList<ReviewLog>& logs, const QSqlDatabase& db) {
+    if (logs.isEmpty()) return true;
+    QSqlDatabase conn = db.isValid() ? db : m_db;
+    if (!conn.transaction()) {
+        qWarning() << "Failed to begin transaction:" << conn.lastError();
+        return false;
+    }
+    if (!writeReviewLogs(logs, conn)) {
+        conn.rollback();
+        return false;
+    }
+    return conn.commit();
+}
+
+bool DatabaseManager::writeReviewLogs(QList<ReviewLog>& logs, const QSqlDatabase& db) {
+    QSqlQuery query(db);
+    query.prepare("INSERT INTO review_logs (word_id, rating, state, elapsed_days, scheduled_days, reviewed_at, kind) "
+                  "VALUES (:word_id, :rating, :state, :elapsed, :scheduled, :reviewed_at, :kind)");
+    for (ReviewLog& log : logs) {
+        query.bindValue(":word_id", log.wordId);
+        query.bindValue(":rating", log.rating);
+        query.bindValue(":state", log.state);
+        query.bindValue(":elapsed", log.elapsedDays);
+        query.bindValue(":scheduled", log.scheduledDays);
+        query.bindValue(":reviewed_at", log.reviewedAt);
+        query.bindValue(":kind", log.kind);
+        if (!query.exec()) {
+            qCritical() << "Error adding review log:" << query.lastError();
+            return false;
+        }
+        log.id = query.lastInsertId().toLongLong();
+    }
+    return true;
+}
+
+bool DatabaseManager::applyReviews(const QList<FsrsCard>& cards, QList<ReviewLog>& logs) {
+    if (cards.isEmpty() && logs.isEmpty()) return true;
+    if (!m_db.transaction()) {
+        qWarning() << "Failed to begin transaction:" << m_db.lastError();
+        return false;
+    }
+    if (!writeCards(cards) || !writeReviewLogs(logs)) {
+        m_db.rollback();
+        return false;
+    }
+    if (!m_db.commit()) return false;
+    for (const FsrsCard& card : cards) {
+        if (m_dueIndex.contains(card.wordId)) m_dueIndex.update(card.wordId, card.due);
+    }
+    return true;
+}
+
+QList<ReviewLog> DatabaseManager::getReviewLogs(const QSqlDatabase& db) const {
+    QList<ReviewLog> logs;
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT id, word_id, rating, state, elapsed_days, scheduled_days, reviewed_at, kind "
+                    "FROM review_logs ORDER BY word_id, reviewed_at, id")) {
+        qWarning() << "Failed to read review logs:" << query.lastError();
+        return logs;
+    }
+    while (query.next()) {
+        ReviewLog log;
+        log.id = query.value(0).toLongLong();
+        log.wordId = query.value(1).toInt();
+        log.rating = query.value(2).toInt();
+        log.state = query.value(3).toInt();
+        log.elapsedDays = query.value(4).toInt();
+        log.scheduledDays = query.value(5).toInt();
+        log.reviewedAt = query.value(6).toDateTime();
+        log.kind = query.value(7).toInt();
+        logs.append(log);
+    }
+    return logs;
+}
+
+QList<int> DatabaseManager::getFirstRatingCounts(const QSqlDatabase& db) const {
+    QList<int> counts(4, 0);
+    QSqlQuery query(db);
+    query.prepare("SELECT rating, COUNT(*) FROM review_logs WHERE state = 0 AND kind = :kind GROUP BY rating");
+    query.bindValue(":kind", int(ReviewKind::Study));
+    if (!query.exec()) {
+        qWarning() << "Failed to count first ratings:" << query.lastError();
+        return counts;
+    }
+    while (query.next()) {
+        const int rating = query.value(0).toInt();
+        if (rating >= FsrsRating::Again && rating <= FsrsRating::Easy) counts[rating - 1] = query.value(1).toInt();
+    }
+    return counts;
+}
@@ -5,8 +5,16 @@
 #include "../core/Word.h"
 #include "../core/Book.h"
 #include "../core/FsrsScheduler.h"
+#include "DueIndex.h"
+#include <QHash>
 #include <QList>
 #include <QMap>
+#include <QSet>
+
+enum class NewWordOrder {
+    Sequential,
+    Random
+};
 
 class DatabaseManager {
 public:
@@ -15,7 +23,24 @@ public:
     bool initTables();
     QSqlDatabase database() const;
 
-    int createBook(const QString& name);
+    // Registers retrievability(stability, last_review[, now]) and
+    // sample_key(weight) on the connection when built against the driver's
+    // own SQLite (see CMakeLists.txt); otherwise queries use plain SQL.
+    bool registerSqlFunctions();
+    // The SQL functions only exist on the main connection; for any other
+    // connection the plain SQL form is returned.
+    QString retrievabilitySql(const QString& stability, const QString& lastReview, const QString& now,
+                              const QSqlDatabase& db = QSqlDatabase()) const;
+
+    // Returns the existing book of that name if there is one; `created`
+    // tells the two apart. 0 on failure.
+    int createBook(const QString& name, bool *created = nullptr);
+    // The book synced from this file, created on first use; 0 on failure.
+    int getSourceBook(const QString& sourcePath, const QString& name, const QSqlDatabase& db = QSqlDatabase());
+    // Unlinks the book synced from a file that is gone. The book keeps its
+    // words and progress and becomes an ordinary book; returns its id, or 0
+    // if no book was linked to the file.
+    int detachSourceBook(const QString& sourcePath, const QSqlDatabase& db = QSqlDatabase());
     QList<Book> getAllBooks() const;
     int getUncategorizedWordCount() const;
     bool deleteBook(int bookId);
@@ -27,17 +52,64 @@ public:
     QMap<QString, int> getReviewHistory();
 
     bool addWord(const Word& word);
-    bool deleteWord(int wordId);
+    bool addWords(QList<Word>& words, const QSqlDatabase& db = QSqlDatabase());
+    QList<WordDigest> getWordDigests(int bookId, const QSqlDatabase& db = QSqlDatabase()) const;
+    bool applyWordDiff(int bookId, QList<Word>& inserted, const QList<Word>& updated, const QList<int>& deletedIds,
+                       const QSqlDatabase& db = QSqlDatabase());
+    bool deleteWord(int wordId, int bookId = -1);
     bool setFavorite(int wordId, bool favorite);
     
     QList<Word> getAllWords(int bookId = -1) const; 
     QList<Word> getDueWords(int bookId = -1, int limit = 20) const;
+    // Exactly `count` words (fewer if the book is smaller), drawn without
+    // replacement with weak cards more likely; the sampling runs in SQLite.
+    QList<Word> getTestWords(int bookId, int count) const;
+    QList<Word> getAtRiskWords(int bookId = -1, int limit = 20, const QSet<int>& excludeIds = QSet<int>(),
+                               const QSqlDatabase& db = QSqlDatabase()) const;
+    // The read helpers below take an optional connection so a worker thread
+    // can run them on its own; the default is the main connection.
+    QList<Word> getNewWords(int bookId, int limit, NewWordOrder order = NewWordOrder::Random,
+                            const QSet<int>& excludeIds = QSet<int>(),
+                            const QSqlDatabase& db = QSqlDatabase()) const;
+    QList<Word> getWordsByIds(const QList<int>& ids, int bookId = -1,
+                              const QSqlDatabase& db = QSqlDatabase()) const;
+    QList<FsrsCard> getCards(const QList<int>& wordIds, const QSqlDatabase& db = QSqlDatabase()) const;
+    // Ids of the words due now, in due order, walked straight off the DueIndex,
+    // which also holds book membership; SQLite is not read. A cursor resumes
+    // the walk where the previous call left it.
+    QList<int> getDueWordIds(int bookId, int limit, const QSet<int>& excludeIds = QSet<int>(),
+                             DueIndex::Cursor *cursor = nullptr) const;
+
+    // Confusable words per word id, nearest first (see NeighborIndexer).
+    QHash<int, QList<int>> getWordNeighbors(int bookId) const;
+    bool hasFreshWordNeighbors(int bookId) const;
 
     FsrsCard getCard(int wordId);
+    QList<FsrsCard> getAllCards(const QSqlDatabase& db = QSqlDatabase()) const;
+    const DueIndex& dueIndex() const;
     bool updateCard(const FsrsCard& card);
+    bool updateCards(const QList<FsrsCard>& cards);
+    bool addCards(QList<FsrsCard>& cards, const QSqlDatabase& db = QSqlDatabase());
+
+    bool addReviewLog(const ReviewLog& log);
+    bool addReviewLogs(QList<ReviewLog>& logs, const QSqlDatabase& db = QSqlDatabase());
+    QList<ReviewLog> getReviewLogs(const QSqlDatabase& db = QSqlDatabase()) const;
+    // How often each rating 1..4 was the first study rating of a new card.
+    QList<int> getFirstRatingCounts(const QSqlDatabase& db = QSqlDatabase()) const;
+    // Card updates and their review logs in one transaction.
+    bool applyReviews(const QList<FsrsCard>& cards, QList<ReviewLog>& logs);
 
 private:
     DatabaseManager();
     ~DatabaseManager();
+    bool migrateWordsToLexemes();
+    bool initNewWordSampling();
+    bool pruneLexemes(const QList<int>& lexemeIds, QList<int>& removedCards,
+                      const QSqlDatabase& db = QSqlDatabase());
+    QString sampleKeySql(const QString& weight) const;
+    bool writeCards(const QList<FsrsCard>& cards);
+    bool writeReviewLogs(QList<ReviewLog>& logs, const QSqlDatabase& db = QSqlDatabase());
     QSqlDatabase m_db;
+    DueIndex m_dueIndex;
+    bool m_hasSqlFunctions = false;
 };
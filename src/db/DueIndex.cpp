@@ -0,0 +1,152 @@
+#include "DueIndex.h"
+#include <QSqlQuery>
+#include <QDebug>
+
+static qint64 dayOf(qint64 msecs) {
+    return QDateTime::fromMSecsSinceEpoch(msecs).date().toJulianDay();
+}
+
+void DueIndex::clear() {
+    QWriteLocker lock(&m_lock);
+    m_entries.clear();
+    m_dueByWord.clear();
+    m_perDay.clear();
+    m_booksByWord.clear();
+    m_countedUpTo = std::numeric_limits<qint64>::min();
+    m_dueUpTo = 0;
+}
+
+bool DueIndex::load(const QSqlDatabase& db) {
+    clear();
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT word_id, due FROM cards WHERE due IS NOT NULL")) {
+        qWarning() << "DueIndex: failed to load cards";
+        return false;
+    }
+    QWriteLocker lock(&m_lock);
+    while (query.next()) {
+        QDateTime due = query.value(1).toDateTime();
+        if (due.isValid()) insert(query.value(0).toInt(), due.toMSecsSinceEpoch());
+    }
+    if (!query.exec("SELECT lexeme_id, book_id FROM book_words")) {
+        qWarning() << "DueIndex: failed to load book memberships";
+        return false;
+    }
+    while (query.next()) {
+        m_booksByWord.insert(query.value(0).toInt(), query.value(1).toInt());
+    }
+    return true;
+}
+
+void DueIndex::insert(int wordId, qint64 due) {
+    m_entries.insert({due, wordId});
+    m_dueByWord.insert(wordId, due);
+    m_perDay[dayOf(due)]++;
+    if (due <= m_countedUpTo) m_dueUpTo++;
+}
+
+void DueIndex::erase(int wordId) {
+    auto it = m_dueByWord.find(wordId);
+    if (it == m_dueByWord.end()) return;
+
+    const qint64 due = it.value();
+    m_entries.erase({due, wordId});
+    m_dueByWord.erase(it);
+    if (due <= m_countedUpTo) m_dueUpTo--;
+    auto day = m_perDay.find(dayOf(due));
+    if (day != m_perDay.end() && --day.value() <= 0) m_perDay.erase(day);
+}
+
+void DueIndex::update(int wordId, const QDateTime& due) {
+    QWriteLocker lock(&m_lock);
+    erase(wordId);
+    if (due.isValid()) insert(wordId, due.toMSecsSinceEpoch());
+}
+
+void DueIndex::remove(int wordId) {
+    QWriteLocker lock(&m_lock);
+    erase(wordId);
+}
+
+void DueIndex::addMember(int wordId, int bookId) {
+    QWriteLocker lock(&m_lock);
+    if (!m_booksByWord.contains(wordId, bookId)) m_booksByWord.insert(wordId, bookId);
+}
+
+void DueIndex::removeMember(int wordId, int bookId) {
+    QWriteLocker lock(&m_lock);
+    m_booksByWord.remove(wordId, bookId);
+}
+
+void DueIndex::removeMembers(int wordId) {
+    QWriteLocker lock(&m_lock);
+    m_booksByWord.remove(wordId);
+}
+
+bool DueIndex::contains(int wordId) const {
+    QReadLocker lock(&m_lock);
+    return m_dueByWord.contains(wordId);
+}
+
+QDateTime DueIndex::dueOf(int wordId) const {
+    QReadLocker lock(&m_lock);
+    auto it = m_dueByWord.constFind(wordId);
+    return it == m_dueByWord.constEnd() ? QDateTime() : QDateTime::fromMSecsSinceEpoch(it.value());
+}
+
+int DueIndex::size() const {
+    QReadLocker lock(&m_lock);
+    return int(m_entries.size());
+}
+
+int DueIndex::dueCount(const QDateTime& now) const {
+    // Only the entries between the previous mark and `now` are walked; the
+    // write lock covers moving the mark.
+    const qint64 t = now.toMSecsSinceEpoch();
+    QWriteLocker lock(&m_lock);
+    if (t >= m_countedUpTo) {
+        auto it = m_entries.upper_bound({m_countedUpTo, std::numeric_limits<int>::max()});
+        for (; it != m_entries.end() && it->first <= t; ++it) m_dueUpTo++;
+    } else {
+        // The clock went back; uncount what lies past the new mark.
+        auto it = m_entries.upper_bound({t, std::numeric_limits<int>::max()});
+        for (; it != m_entries.end() && it->first <= m_countedUpTo; ++it) m_dueUpTo--;
+    }
+    m_countedUpTo = t;
+    return m_dueUpTo;
+}
+
+QList<int> DueIndex::nextDue(int k, const QDateTime& before, int bookId, Cursor *cursor, const Filter& accept) const {
+    QList<int> ids;
+    if (k <= 0) return ids;
+    const qint64 t = before.toMSecsSinceEpoch();
+    QReadLocker lock(&m_lock);
+    auto it = cursor ? m_entries.upper_bound({cursor->due, cursor->wordId}) : m_entries.begin();
+    auto last = m_entries.end();
+    for (; it != m_entries.end() && it->first <= t && ids.size() < k; ++it) {
+        last = it;
+        if (bookId != -1 && !m_booksByWord.contains(it->second, bookId)) continue;
+        if (!accept || accept(it->second)) ids.append(it->second);
+    }
+    if (cursor && last != m_entries.end()) {
+        cursor->due = last->first;
+        cursor->wordId = last->second;
+    }
+    return ids;
+}
+
+int DueIndex::dueOn(const QDate& date) const {
+    QReadLocker lock(&m_lock);
+    return m_perDay.value(date.toJulianDay(), 0);
+}
+
+QMap<QDate, int> DueIndex::duePerDay(const QDate& from, int days) const {
+    QMap<QDate, int> result;
+    const qint64 first = from.toJulianDay();
+    QReadLocker lock(&m_lock);
+    for (auto it = m_perDay.lowerBound(first); it != m_perDay.end() && it.key() < first + days; ++it) {
+        result.insert(QDate::fromJulianDay(it.key()), it.value());
+    }
+    return result;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QReadWriteLock>
+#include <QSqlDatabase>
+#include <functional>
+#include <limits>
+#include <set>
+#include <utility>
+
+// In-memory index of card due times, keyed by word (lexeme) id, plus the
+// books each word belongs to. Loaded once from `cards` and `book_words` and
+// kept current by DatabaseManager on every card and membership write, so due
+// queues and counts never have to touch SQLite.
+//
+// Entries live in an ordered set (next-k in O(log n + k), resumable from a
+// cursor); a per-day histogram answers per-day counts in O(log d). The due
+// count is kept as a running total up to a time mark that only moves
+// forward, so each entry is counted once as it comes due. Reads may come
+// from worker threads, so every call takes the index lock.
+class DueIndex {
+public:
+    // Position in due order just past the last entry a walk visited. A
+    // default cursor starts at the front.
+    struct Cursor {
+        qint64 due = std::numeric_limits<qint64>::min();
+        int wordId = std::numeric_limits<int>::min();
+    };
+    using Filter = std::function<bool(int wordId)>;
+
+    void clear();
+    bool load(const QSqlDatabase& db);
+
+    void update(int wordId, const QDateTime& due);
+    void remove(int wordId);
+    void addMember(int wordId, int bookId);
+    void removeMember(int wordId, int bookId);
+    // Drops every membership of the word.
+    void removeMembers(int wordId);
+    bool contains(int wordId) const;
+    QDateTime dueOf(int wordId) const;
+    int size() const;
+
+    int dueCount(const QDateTime& now = QDateTime::currentDateTime()) const;
+    // Up to k ids due by `before` in book `bookId` (-1 for any) that pass
+    // `accept`, in due order. With a cursor the walk resumes where the
+    // previous call stopped and leaves the cursor after the last entry it
+    // looked at, accepted or not.
+    QList<int> nextDue(int k, const QDateTime& before, int bookId = -1, Cursor *cursor = nullptr,
+                       const Filter& accept = Filter()) const;
+    int dueOn(const QDate& date) const;
+    QMap<QDate, int> duePerDay(const QDate& from, int days) const;
+
+private:
+    using Entry = std::pair<qint64, int>;
+
+    void insert(int wordId, qint64 due);
+    void erase(int wordId);
+
+    mutable QReadWriteLock m_lock;
+    std::set<Entry> m_entries;
+    QHash<int, qint64> m_dueByWord;
+    QMap<qint64, int> m_perDay;
+    QMultiHash<int, int> m_booksByWord;
+    // Entries due at or before m_countedUpTo; moved by dueCount() under the
+    // write lock.
+    mutable qint64 m_countedUpTo = std::numeric_limits<qint64>::min();
+    mutable int m_dueUpTo = 0;
+};
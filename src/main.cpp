@@ -1,6 +1,8 @@
 #include "ui/MainWindow.h"
 #include "db/DatabaseManager.h"
 #include "ui/ThemeManager.h"
+#include "core/TtsEngine.h"
+#include "core/NeighborIndexer.h"
 #include <QApplication>
 #include <QStandardPaths>
 #include <QDir>
@@ -32,6 +34,12 @@ int main(int argc, char *argv[]) {
     MainWindow window;
     window.show();
 
+    // Starts the speech engine on its own thread while the window comes up.
+    TtsEngine::instance();
+
+    // Background indexing would otherwise hold up exit until it finishes.
+    QObject::connect(&app, &QCoreApplication::aboutToQuit, []() { NeighborIndexer::cancelAll(); });
+
     return app.exec();
 }
 
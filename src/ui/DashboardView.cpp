@@ -1,10 +1,15 @@
 #include "DashboardView.h"
 #include "../db/DatabaseManager.h"
+#include "../core/WorkloadSimulator.h"
 #include <QVBoxLayout>
 #include <QFrame>
 #include <QFrame>
 #include <QDateTime>
 #include <QPaintEvent>
+#include <QSqlDatabase>
+#include <QThread>
+#include <QCoreApplication>
+#include <memory>
 
 DashboardView::DashboardView(QWidget *parent) : QWidget(parent) {
     QVBoxLayout *mainLayout = new QVBoxLayout(this);
@@ -36,12 +41,19 @@ DashboardView::DashboardView(QWidget *parent) : QWidget(parent) {
     QWidget *cardDue = createStatCard(QStringLiteral("今日待复习"), "0", "#F59E0B", m_lblDueWords);
     gridLayout->addWidget(cardDue, 0, 2);
 
+
+    QWidget *cardForecast = createStatCard(QStringLiteral("未来7天日均复习"), "0", "#8B5CF6", m_lblForecast);
+    gridLayout->addWidget(cardForecast, 0, 3);
+
     mainLayout->addLayout(gridLayout);
     
     m_chartWidget = new LearningChart(this);
     mainLayout->addWidget(m_chartWidget);
     
     mainLayout->addStretch();
+
+    // Stop the simulation before the event loop and the database go away.
+    connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, &DashboardView::stopForecast);
 }
 
 QWidget* DashboardView::createStatCard(const QString& title, const QString& value, const QString& color, QLabel*& outLabel) {
@@ -80,7 +92,74 @@ void DashboardView::refreshStats() {
     m_lblLearnedWords->setText(QString::number(learned));
     m_lblDueWords->setText(QString::number(due));
 
+    startForecast(total);
+
     m_chartWidget->setData(DatabaseManager::instance().getReviewHistory());
 }
 
+DashboardView::~DashboardView() {
+    stopForecast();
+}
+
+void DashboardView::stopForecast() {
+    m_forecastPending = -1;
+    if (!m_forecastThread) return;
+    m_forecastStop = true;
+    m_forecastThread->wait();
+    delete m_forecastThread;
+    m_forecastThread = nullptr;
+}
 
+void DashboardView::startForecast(int totalWords) {
+    if (m_forecastStop) return;
+    if (m_forecastThread) {
+        m_forecastPending = totalWords;
+        return;
+    }
+    struct Forecast {
+        int reviews = 0;
+        double minutes = 0.0;
+    };
+    auto result = std::make_shared<Forecast>();
+    const std::atomic_bool *stop = &m_forecastStop;
+    m_forecastThread = QThread::create([result, totalWords, stop]() {
+        const QString connection = QString("forecast-%1").arg(quintptr(QThread::currentThreadId()), 0, 16);
+        {
+            QSqlDatabase db = QSqlDatabase::cloneDatabase(QSqlDatabase::defaultConnection, connection);
+            if (db.open()) {
+                QList<FsrsCard> cards = DatabaseManager::instance().getAllCards(db);
+                const QList<int> firstRatings = DatabaseManager::instance().getFirstRatingCounts(db);
+                db.close();
+                WorkloadSimulator simulator;
+                simulator.setCards(cards);
+                simulator.setNewCards(totalWords - int(cards.size()), 20);
+                simulator.setFirstRatingCounts(firstRatings);
+                for (const WorkloadDay& day : simulator.simulate(7, stop)) {
+                    result->reviews += day.reviews;
+                    result->minutes += day.minutes;
+                }
+            }
+        }
+        QSqlDatabase::removeDatabase(connection);
+    });
+    // Dropped with the view if it goes away first; the destructor then
+    // deletes the thread.
+    connect(m_forecastThread, &QThread::finished, this, [this, result]() {
+        if (!m_forecastThread) return;
+        m_forecastThread->wait();
+        m_forecastThread->deleteLater();
+        m_forecastThread = nullptr;
+        showForecast(result->reviews, result->minutes);
+        if (m_forecastPending >= 0) {
+            int pending = m_forecastPending;
+            m_forecastPending = -1;
+            startForecast(pending);
+        }
+    });
+    m_forecastThread->start(QThread::LowPriority);
+}
+
+void DashboardView::showForecast(int reviews, double minutes) {
+    m_lblForecast->setText(QString::number(reviews / 7));
+    m_lblForecast->setToolTip(tr("约 %1 分钟/天").arg(qRound(minutes / 7)));
+}
@@ -4,24 +4,40 @@
 #include <QLabel>
 #include <QGridLayout>
 #include <QMap>
+#include <atomic>
 
 #include "LearningChart.h"
 
+class QThread;
+
 class DashboardView : public QWidget {
     Q_OBJECT
 
 public:
     explicit DashboardView(QWidget *parent = nullptr);
+    ~DashboardView();
     void refreshStats();
 
 protected:
     void showEvent(QShowEvent *event) override;
 
 private:
+    // Runs the 7-day workload simulation on a worker thread; a refresh that
+    // arrives meanwhile reruns it once the current run is done.
+    void startForecast(int totalWords);
+    // Asks a running simulation to stop and waits for it, on quit or when
+    // the view goes away.
+    void stopForecast();
+    void showForecast(int reviews, double minutes);
+
     QWidget* createStatCard(const QString& title, const QString& value, const QString& color, QLabel*& outLabel);
     
     QLabel *m_lblTotalWords;
     QLabel *m_lblLearnedWords;
     QLabel *m_lblDueWords;
+    QLabel *m_lblForecast;
     LearningChart *m_chartWidget;
+    QThread *m_forecastThread = nullptr;
+    std::atomic_bool m_forecastStop{false};
+    int m_forecastPending = -1;
 };
@@ -12,6 +12,7 @@
 #include <QGraphicsOpacityEffect>
 #include <QParallelAnimationGroup>
 #include <QIcon>
+#include <QSettings>
 
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     setupUi();
@@ -87,7 +88,20 @@ void MainWindow::setupUi() {
         if (dlg.exec() == QDialog::Accepted) {
             m_studyView->refreshBooks();
         }
+        applySyncFolder();
     });
+
+    m_folderSync = new FolderSync(this);
+    connect(m_folderSync, &FolderSync::bookSynced, this, [this](){
+        m_studyView->refreshBooks();
+        m_dashboardView->refreshStats();
+    });
+    applySyncFolder();
+}
+
+void MainWindow::applySyncFolder() {
+    QSettings settings("AutoWord", "Config");
+    m_folderSync->setFolder(settings.value("Sync/WatchFolder").toString());
 }
 
 void MainWindow::switchPage(QWidget *page) {
@@ -6,6 +6,7 @@
 #include "PreviewView.h"
 #include "StudyView.h"
 #include "TestView.h"
+#include "../core/FolderSync.h"
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -22,10 +23,12 @@ private slots:
 private:
     void setupUi();
     void switchPage(QWidget *page);
+    void applySyncFolder();
     
     QStackedWidget *m_stackedWidget;
     DashboardView *m_dashboardView;
     PreviewView *m_previewView;
     StudyView *m_studyView;
     TestView *m_testView;
+    FolderSync *m_folderSync;
 };
@@ -5,6 +5,7 @@
 #include <QMessageBox>
 #include <QAction>
 #include <QLabel>
+#include <QFileDialog>
 
 PreviewView::PreviewView(QWidget *parent) : QWidget(parent) {
     m_model = new WordModel(this);
@@ -34,6 +35,9 @@ void PreviewView::setupUi() {
     m_btnDeleteBook->setEnabled(false);
     connect(m_btnDeleteBook, &QPushButton::clicked, this, &PreviewView::onDeleteBook);
 
+    m_btnOpenPack = new QPushButton(tr("打开词库包"), this);
+    connect(m_btnOpenPack, &QPushButton::clicked, this, &PreviewView::onOpenPack);
+
     m_btnSortAZ = new QPushButton(tr("A-Z 排序"), this);
     m_btnSortRandom = new QPushButton(tr("随机乱序"), this);
     
@@ -46,6 +50,7 @@ void PreviewView::setupUi() {
     toolbarLayout->addWidget(m_searchBar);
     toolbarLayout->addWidget(m_btnDeleteBook);
     toolbarLayout->addWidget(m_btnDeleteBook);
+    toolbarLayout->addWidget(m_btnOpenPack);
     toolbarLayout->addWidget(m_btnSortAZ);
     toolbarLayout->addWidget(m_btnSortRandom);
     toolbarLayout->addStretch();
@@ -106,8 +111,8 @@ void PreviewView::onDeleteWord() {
     int wordId = index.data(WordModel::IdRole).toInt();
     
     if (QMessageBox::question(this, tr("确认删除"), tr("确定要删除单词 \"%1\" 吗？").arg(spelling)) == QMessageBox::Yes) {
-        if (DatabaseManager::instance().deleteWord(wordId)) {
-            int bookId = m_comboBook->currentData().toInt();
+        int bookId = m_comboBook->currentData().toInt();
+        if (DatabaseManager::instance().deleteWord(wordId, bookId)) {
             m_model->loadWords(bookId);
             refreshBooks(); 
         }
@@ -132,6 +137,18 @@ void PreviewView::onDeleteBook() {
     }
 }
 
+void PreviewView::onOpenPack() {
+    QString fileName = QFileDialog::getOpenFileName(this, tr("打开词库包"), "", tr("Dictionary Packs (*.awpack)"));
+    if (fileName.isEmpty()) return;
+
+    if (!m_model->loadPack(fileName)) {
+        QMessageBox::warning(this, tr("打开词库包"), tr("无法读取词库包: %1").arg(fileName));
+        return;
+    }
+    m_searchBar->clear();
+    m_btnDeleteBook->setEnabled(false);
+}
+
 void PreviewView::onSortAZ() {
     m_model->sortWords(WordModel::Alphabetical);
 }
@@ -30,8 +30,10 @@ private:
     QPushButton *m_btnSortRandom;
     QComboBox *m_comboBook;
     QPushButton *m_btnDeleteBook;
+    QPushButton *m_btnOpenPack;
     
     void refreshBooks();
     void onDeleteWord();
     void onDeleteBook();
+    void onOpenPack();
 };
@@ -2,6 +2,13 @@
 #include "ThemeManager.h"
 #include "../network/WebDavClient.h"
 #include "../core/DictionaryParser.h"
+#include "../core/DictionaryPack.h"
+#include "../core/AudioPack.h"
+#include "../core/TtsEngine.h"
+#include "../core/MdxParser.h"
+#include "../core/AnkiImporter.h"
+#include "../core/FsrsOptimizer.h"
+#include "../core/RescheduleEngine.h"
 #include "../db/DatabaseManager.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
@@ -10,6 +17,148 @@
 #include <QFileDialog>
 #include <QSettings>
 #include <QMessageBox>
+#include <QFileInfo>
+#include <QDir>
+#include <QApplication>
+#include <QProgressDialog>
+#include <QEventLoop>
+#include <QThread>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QTimer>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+
+namespace {
+
+// Streams an MDict file into a book through a connection of its own, so it
+// can run off the UI thread. Stops at the first batch that cannot be written.
+bool importMdx(const QString& fileName, int bookId, int& count, QString& error) {
+    const QString connection = QString("mdx-import-%1").arg(quintptr(QThread::currentThreadId()), 0, 16);
+    bool ok = false;
+    {
+        QSqlDatabase db = QSqlDatabase::cloneDatabase(QSqlDatabase::defaultConnection, connection);
+        if (!db.open()) {
+            error = db.lastError().text();
+        } else {
+            MdxParser parser(fileName);
+            bool written = true;
+            ok = parser.parse([&](QList<Word>& batch) {
+                for (Word& word : batch) {
+                    word.bookId = bookId;
+                }
+                written = DatabaseManager::instance().addWords(batch, db);
+                if (written) count += batch.size();
+                return written;
+            });
+            if (!written) {
+                error = QObject::tr("写入数据库失败");
+            } else if (!ok) {
+                error = parser.errorString();
+            }
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(connection);
+    return ok;
+}
+
+// Same for an Anki package: unzipping, inflating and the review replay all
+// happen on the calling thread's own connection.
+bool importApkg(const QString& fileName, int bookId, int& notes, int& cards, QString& error) {
+    const QString connection = QString("apkg-import-%1").arg(quintptr(QThread::currentThreadId()), 0, 16);
+    bool ok = false;
+    {
+        QSqlDatabase db = QSqlDatabase::cloneDatabase(QSqlDatabase::defaultConnection, connection);
+        if (!db.open()) {
+            error = db.lastError().text();
+        } else {
+            AnkiImporter importer(fileName);
+            ok = importer.import(bookId, db);
+            notes = importer.importedNotes();
+            cards = importer.importedCards();
+            if (!ok) error = importer.errorString();
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(connection);
+    return ok;
+}
+
+// Shared between a worker and its progress dialog.
+struct WorkerProgress {
+    std::atomic_int done{0};
+    std::atomic_int total{0};
+    std::atomic_bool cancelled{false};
+};
+
+// Runs `work` on a thread of its own behind a progress dialog and returns
+// once it is done; the UI keeps painting meanwhile. Without `progress` the
+// dialog is a busy indicator; with it, the dialog shows done out of total
+// and its cancel button sets `cancelled` for the worker to notice.
+void runWithProgress(QWidget *parent, const QString& label, const std::function<void()>& work,
+                     WorkerProgress *progress = nullptr) {
+    QProgressDialog dialog(label, progress ? QObject::tr("取消") : QString(), 0, 0, parent);
+    dialog.setWindowModality(Qt::WindowModal);
+    dialog.setMinimumDuration(0);
+    dialog.setAutoClose(false);
+    dialog.setAutoReset(false);
+    dialog.show();
+
+    QTimer poll;
+    if (progress) {
+        QObject::connect(&dialog, &QProgressDialog::canceled, [progress]() { progress->cancelled = true; });
+        QObject::connect(&poll, &QTimer::timeout, [&dialog, progress]() {
+            const int total = progress->total;
+            if (total > 0) {
+                dialog.setMaximum(total);
+                dialog.setValue(std::min(int(progress->done), total));
+            }
+        });
+        poll.start(100);
+    }
+
+    QEventLoop loop;
+    QThread *worker = QThread::create(work);
+    QObject::connect(worker, &QThread::finished, &loop, &QEventLoop::quit);
+    worker->start();
+    loop.exec();
+    worker->wait();
+    delete worker;
+    dialog.close();
+}
+
+// Reads the review history on a connection of its own and fits the weights,
+// reporting each optimizer step.
+bool optimizeWeights(FsrsOptimizer& optimizer, WorkerProgress& progress, QString& error) {
+    const QString connection = QString("optimize-%1").arg(quintptr(QThread::currentThreadId()), 0, 16);
+    QList<ReviewLog> logs;
+    bool opened = false;
+    {
+        QSqlDatabase db = QSqlDatabase::cloneDatabase(QSqlDatabase::defaultConnection, connection);
+        opened = db.open();
+        if (opened) {
+            logs = DatabaseManager::instance().getReviewLogs(db);
+            db.close();
+        } else {
+            error = db.lastError().text();
+        }
+    }
+    QSqlDatabase::removeDatabase(connection);
+    if (!opened) return false;
+
+    optimizer.setReviewLogs(logs);
+    const bool ok = optimizer.optimize(100, 0.04, [&progress](int done, int total) {
+        progress.total = total;
+        progress.done = done;
+        return !progress.cancelled;
+    });
+    if (!ok) error = optimizer.errorString();
+    return ok;
+}
+
+}
 
 SettingsDialog::SettingsDialog(QWidget *parent) : QDialog(parent) {
     setupUi();
@@ -38,8 +187,50 @@ void SettingsDialog::setupUi() {
     m_btnImport = new QPushButton(tr("导入词库 (CSV)"), this);
     connect(m_btnImport, &QPushButton::clicked, this, &SettingsDialog::onImportDictionary);
     dictLayout->addWidget(m_btnImport);
+    m_btnCompilePack = new QPushButton(tr("编译词库包"), this);
+    connect(m_btnCompilePack, &QPushButton::clicked, this, &SettingsDialog::onCompilePack);
+    dictLayout->addWidget(m_btnCompilePack);
+    m_btnCompileAudioPack = new QPushButton(tr("编译发音包"), this);
+    m_btnCompileAudioPack->setToolTip(tr("把以单词命名的录音文件夹打包，朗读时优先使用"));
+    connect(m_btnCompileAudioPack, &QPushButton::clicked, this, &SettingsDialog::onCompileAudioPack);
+    dictLayout->addWidget(m_btnCompileAudioPack);
+
+    QHBoxLayout *watchLayout = new QHBoxLayout();
+    m_editWatchFolder = new QLineEdit(this);
+    m_editWatchFolder->setPlaceholderText(tr("文件夹中的词表改动后自动同步"));
+    QPushButton *btnBrowse = new QPushButton(tr("浏览..."), this);
+    connect(btnBrowse, &QPushButton::clicked, this, &SettingsDialog::onBrowseWatchFolder);
+    watchLayout->addWidget(m_editWatchFolder);
+    watchLayout->addWidget(btnBrowse);
+    dictLayout->addWidget(new QLabel(tr("监视文件夹:"), this));
+    dictLayout->addLayout(watchLayout);
     mainLayout->addWidget(grpDict);
 
+    QGroupBox *grpFsrs = new QGroupBox(tr("复习算法"), this);
+    QVBoxLayout *fsrsLayout = new QVBoxLayout(grpFsrs);
+    m_spinRetention = new QDoubleSpinBox(this);
+    m_spinRetention->setRange(0.70, 0.99);
+    m_spinRetention->setSingleStep(0.01);
+    m_spinRetention->setDecimals(2);
+    m_spinRetention->setToolTip(tr("调低可减少复习次数，但会忘记更多单词"));
+    fsrsLayout->addWidget(new QLabel(tr("目标记忆保持率:"), this));
+    fsrsLayout->addWidget(m_spinRetention);
+    m_chkLoadBalancing = new QCheckBox(tr("平衡每日复习量"), this);
+    m_chkLoadBalancing->setToolTip(tr("在理想间隔附近选择复习最少的一天"));
+    fsrsLayout->addWidget(m_chkLoadBalancing);
+    m_comboNewOrder = new QComboBox(this);
+    m_comboNewOrder->addItem(tr("随机"));
+    m_comboNewOrder->addItem(tr("按词书顺序"));
+    fsrsLayout->addWidget(new QLabel(tr("新词顺序:"), this));
+    fsrsLayout->addWidget(m_comboNewOrder);
+    m_btnOptimize = new QPushButton(tr("根据复习记录优化参数"), this);
+    connect(m_btnOptimize, &QPushButton::clicked, this, &SettingsDialog::onOptimizeWeights);
+    fsrsLayout->addWidget(m_btnOptimize);
+    m_btnReschedule = new QPushButton(tr("按当前参数重排复习计划"), this);
+    connect(m_btnReschedule, &QPushButton::clicked, this, &SettingsDialog::onReschedule);
+    fsrsLayout->addWidget(m_btnReschedule);
+    mainLayout->addWidget(grpFsrs);
+
     QGroupBox *grpSync = new QGroupBox(tr("WebDAV 同步"), this);
     QVBoxLayout *syncLayout = new QVBoxLayout(grpSync);
     
@@ -86,6 +277,10 @@ void SettingsDialog::loadSettings() {
     m_editWebDavUrl->setText(settings.value("WebDav/Url").toString());
     m_editWebDavUser->setText(settings.value("WebDav/User").toString());
     m_editWebDavPass->setText(settings.value("WebDav/Pass").toString());
+    m_editWatchFolder->setText(settings.value("Sync/WatchFolder").toString());
+    m_spinRetention->setValue(FsrsScheduler::storedRetention(FsrsScheduler::currentProfile()));
+    m_chkLoadBalancing->setChecked(settings.value("Fsrs/LoadBalancing", false).toBool());
+    m_comboNewOrder->setCurrentIndex(settings.value("Study/NewWordOrder", 0).toInt());
     
     ThemeManager::Theme theme = (ThemeManager::Theme)settings.value("Theme", (int)ThemeManager::Theme::Auto).toInt();
     int index = m_comboTheme->findData(QVariant::fromValue(theme));
@@ -97,6 +292,10 @@ void SettingsDialog::saveSettings() {
     settings.setValue("WebDav/Url", m_editWebDavUrl->text());
     settings.setValue("WebDav/User", m_editWebDavUser->text());
     settings.setValue("WebDav/Pass", m_editWebDavPass->text());
+    settings.setValue("Sync/WatchFolder", m_editWatchFolder->text());
+    FsrsScheduler::storeRetention(FsrsScheduler::currentProfile(), m_spinRetention->value());
+    settings.setValue("Fsrs/LoadBalancing", m_chkLoadBalancing->isChecked());
+    settings.setValue("Study/NewWordOrder", m_comboNewOrder->currentIndex());
     settings.setValue("Theme", m_comboTheme->currentData().toInt());
     QMessageBox::information(this, tr("保存"), tr("设置已保存"));
 }
@@ -107,27 +306,179 @@ void SettingsDialog::onSave() {
 }
 
 void SettingsDialog::onImportDictionary() {
-    QString fileName = QFileDialog::getOpenFileName(this, tr("导入词库"), "", tr("Dictionary Files (*.csv *.txt *.json);;CSV Files (*.csv);;Text Files (*.txt);;JSON Files (*.json)"));
+    QString fileName = QFileDialog::getOpenFileName(this, tr("导入词库"), "", tr("Dictionary Files (*.csv *.txt *.json *.mdx *.apkg);;CSV Files (*.csv);;Text Files (*.txt);;JSON Files (*.json);;MDict Files (*.mdx);;Anki Packages (*.apkg)"));
     if (fileName.isEmpty()) return;
 
     QFileInfo fileInfo(fileName);
     QString bookName = fileInfo.completeBaseName();
-    int bookId = DatabaseManager::instance().createBook(bookName);
+    bool created = false;
+    int bookId = DatabaseManager::instance().createBook(bookName, &created);
+    if (bookId <= 0) {
+        QMessageBox::warning(this, tr("导入失败"), tr("无法创建词书《%1》").arg(bookName));
+        return;
+    }
+    // A failed import leaves no half-filled book behind, unless the book
+    // was already there.
+    auto discardBook = [bookId, created]() {
+        if (created) DatabaseManager::instance().deleteBook(bookId);
+    };
+
+    if (fileInfo.suffix().toLower() == "apkg") {
+        int notes = 0;
+        int cards = 0;
+        QString error;
+        bool ok = false;
+        runWithProgress(this, tr("正在导入 Anki 牌组..."), [&]() {
+            ok = importApkg(fileName, bookId, notes, cards, error);
+        });
+        if (!ok) {
+            discardBook();
+            QMessageBox::warning(this, tr("导入失败"), tr("无法导入 Anki 牌组: %1").arg(error));
+            return;
+        }
+        QMessageBox::information(this, tr("导入完成"), tr("成功导入 %1 个单词和 %2 条复习记录到词书《%3》")
+            .arg(notes).arg(cards).arg(bookName));
+        accept();
+        return;
+    }
 
-    QList<Word> words = DictionaryParser::parseFile(fileName);
     int count = 0;
-    
-    for (Word& word : words) {
-        word.bookId = bookId; 
-        if (DatabaseManager::instance().addWord(word)) {
-            count++;
+    QString error;
+    bool ok = false;
+    if (fileInfo.suffix().toLower() == "mdx") {
+        runWithProgress(this, tr("正在导入 MDict 词典..."), [&]() {
+            ok = importMdx(fileName, bookId, count, error);
+        });
+    } else {
+        QList<Word> words = DictionaryParser::parseFile(fileName);
+        for (Word& word : words) {
+            word.bookId = bookId;
+        }
+        ok = DatabaseManager::instance().addWords(words);
+        if (ok) {
+            count = words.size();
+        } else {
+            error = tr("写入数据库失败");
         }
     }
 
+    if (ok && count == 0) {
+        ok = false;
+        error = tr("文件中没有可导入的单词");
+    }
+    if (!ok) {
+        discardBook();
+        QMessageBox::warning(this, tr("导入失败"), tr("无法导入 %1: %2").arg(fileInfo.fileName(), error));
+        return;
+    }
+
     QMessageBox::information(this, tr("导入完成"), tr("成功导入 %1 个单词到词书《%2》").arg(count).arg(bookName));
     accept();
 }
 
+void SettingsDialog::onCompilePack() {
+    QString fileName = QFileDialog::getOpenFileName(this, tr("编译词库包"), "", tr("Dictionary Files (*.csv *.txt *.json);;CSV Files (*.csv);;Text Files (*.txt);;JSON Files (*.json)"));
+    if (fileName.isEmpty()) return;
+
+    QFileInfo fileInfo(fileName);
+    QString packName = QFileDialog::getSaveFileName(this, tr("保存词库包"),
+        fileInfo.absoluteDir().filePath(fileInfo.completeBaseName() + ".awpack"), tr("Dictionary Packs (*.awpack)"));
+    if (packName.isEmpty()) return;
+
+    if (DictionaryPack::compile(fileName, packName)) {
+        QMessageBox::information(this, tr("编译完成"), tr("词库包已保存到 %1").arg(packName));
+    } else {
+        QMessageBox::warning(this, tr("编译失败"), tr("无法从 %1 生成词库包").arg(fileName));
+    }
+}
+
+void SettingsDialog::onCompileAudioPack() {
+    QString dir = QFileDialog::getExistingDirectory(this, tr("选择录音文件夹"));
+    if (dir.isEmpty()) return;
+
+    QString packName = QFileDialog::getSaveFileName(this, tr("保存发音包"),
+        QDir(dir).absoluteFilePath("../" + QFileInfo(dir).fileName() + ".awaudio"), tr("Audio Packs (*.awaudio)"));
+    if (packName.isEmpty()) return;
+
+    // The enabled pack stays mapped and a mapped file cannot be replaced on
+    // Windows, so it is released while the new one is written.
+    TtsEngine& tts = TtsEngine::instance();
+    const QString previous = tts.audioPack();
+    tts.setAudioPack(QString());
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    bool ok = AudioPack::compile(dir, packName);
+    QApplication::restoreOverrideCursor();
+    if (ok) {
+        QSettings("AutoWord", "Config").setValue("Tts/AudioPack", packName);
+        tts.setAudioPack(packName);
+        QMessageBox::information(this, tr("编译完成"), tr("发音包已保存到 %1 并已启用").arg(packName));
+    } else {
+        tts.setAudioPack(previous);
+        QMessageBox::warning(this, tr("编译失败"), tr("无法从 %1 生成发音包").arg(dir));
+    }
+}
+
+void SettingsDialog::onBrowseWatchFolder() {
+    QString dir = QFileDialog::getExistingDirectory(this, tr("选择监视文件夹"), m_editWatchFolder->text());
+    if (!dir.isEmpty()) {
+        m_editWatchFolder->setText(dir);
+    }
+}
+
+void SettingsDialog::onOptimizeWeights() {
+    QString profile = FsrsScheduler::currentProfile();
+    FsrsOptimizer optimizer(FsrsScheduler().weights());
+    WorkerProgress progress;
+    QString error;
+    bool ok = false;
+    runWithProgress(this, tr("正在优化参数..."), [&]() {
+        ok = optimizeWeights(optimizer, progress, error);
+    }, &progress);
+
+    if (!ok && progress.cancelled) {
+        QMessageBox::information(this, tr("优化已取消"), tr("参数保持不变"));
+        return;
+    }
+    if (!ok) {
+        QMessageBox::warning(this, tr("优化失败"), tr("无法优化参数: %1").arg(error));
+        return;
+    }
+    FsrsScheduler::storeWeights(profile, optimizer.weights());
+    QMessageBox::information(this, tr("优化完成"), tr("已根据 %1 条复习记录更新参数\n对数损失: %2 → %3")
+        .arg(optimizer.sampleCount())
+        .arg(optimizer.initialLoss(), 0, 'f', 4)
+        .arg(optimizer.finalLoss(), 0, 'f', 4));
+}
+
+void SettingsDialog::onReschedule() {
+    // Uses the saved settings, so apply pending edits first.
+    FsrsScheduler::storeRetention(FsrsScheduler::currentProfile(), m_spinRetention->value());
+
+    QProgressDialog dialog(tr("正在重排复习计划..."), tr("取消"), 0, 100, this);
+    dialog.setWindowModality(Qt::WindowModal);
+    dialog.setMinimumDuration(0);
+
+    RescheduleEngine engine;
+    RescheduleEngine::Result result = engine.run([&dialog](int done, int total) {
+        dialog.setMaximum(std::max(1, total));
+        dialog.setValue(std::min(done, std::max(1, total)));
+        QApplication::processEvents();
+        return !dialog.wasCanceled();
+    });
+    dialog.close();
+
+    if (result == RescheduleEngine::Result::Failed) {
+        QMessageBox::warning(this, tr("重排失败"), tr("无法重排复习计划: %1").arg(engine.errorString()));
+        return;
+    }
+    if (result == RescheduleEngine::Result::Cancelled) {
+        QMessageBox::information(this, tr("重排已取消"), tr("已重新计算 %1 张卡片，其余卡片保持原计划").arg(engine.rescheduledCards()));
+        return;
+    }
+    QMessageBox::information(this, tr("重排完成"), tr("已根据复习记录重新计算 %1 张卡片").arg(engine.rescheduledCards()));
+}
+
 void SettingsDialog::onThemeChanged(int index) {
     ThemeManager::Theme theme = m_comboTheme->itemData(index).value<ThemeManager::Theme>();
     ThemeManager::instance().setTheme(theme);
@@ -3,6 +3,8 @@
 #include <QLineEdit>
 #include <QComboBox>
 #include <QPushButton>
+#include <QDoubleSpinBox>
+#include <QCheckBox>
 
 class SettingsDialog : public QDialog {
     Q_OBJECT
@@ -12,6 +14,11 @@ public:
 
 private slots:
     void onImportDictionary();
+    void onCompilePack();
+    void onCompileAudioPack();
+    void onBrowseWatchFolder();
+    void onOptimizeWeights();
+    void onReschedule();
     void onSyncNow();
     void onThemeChanged(int index);
     void onSave();
@@ -26,6 +33,14 @@ private:
     QLineEdit *m_editWebDavPass;
     QComboBox *m_comboTheme;
     QPushButton *m_btnImport;
+    QPushButton *m_btnCompilePack;
+    QPushButton *m_btnCompileAudioPack;
+    QLineEdit *m_editWatchFolder;
+    QDoubleSpinBox *m_spinRetention;
+    QCheckBox *m_chkLoadBalancing;
+    QComboBox *m_comboNewOrder;
+    QPushButton *m_btnOptimize;
+    QPushButton *m_btnReschedule;
     QPushButton *m_btnSync;
     QPushButton *m_btnSave;
 };
@@ -5,11 +5,20 @@
 #include <QPropertyAnimation>
 #include <QGraphicsOpacityEffect>
 #include <QKeyEvent>
-#include <random>
-#include <chrono>
+#include <QSettings>
 #include <algorithm>
 
+// Words per batch, and how many unseen cards may remain before the next
+// batch is fetched in the background.
+static const int SESSION_BATCH = 20;
+static const int PREFETCH_AHEAD = 5;
+
 StudyView::StudyView(QWidget *parent) : QWidget(parent), m_currentIndex(0) {
+    m_prefetcher = new StudyPrefetcher(this);
+    connect(m_prefetcher, &StudyPrefetcher::batchReady, this, &StudyView::onBatchReady);
+    m_learningTimer = new QTimer(this);
+    m_learningTimer->setSingleShot(true);
+    connect(m_learningTimer, &QTimer::timeout, this, &StudyView::onLearningStepDue);
     setupUi();
 }
 
@@ -24,11 +33,16 @@ void StudyView::setupUi() {
     m_comboBook->setMinimumWidth(200);
     refreshBooks();
     
+    m_comboOrder = new QComboBox(this);
+    m_comboOrder->addItem(tr("到期优先"));
+    m_comboOrder->addItem(tr("易忘优先"));
+
     QPushButton *btnStart = new QPushButton(tr("开始/重置"), this);
     connect(btnStart, &QPushButton::clicked, this, &StudyView::startSession);
     
     topLayout->addWidget(new QLabel(tr("当前词书:"), this));
     topLayout->addWidget(m_comboBook);
+    topLayout->addWidget(m_comboOrder);
     topLayout->addWidget(btnStart);
     topLayout->addStretch();
     
@@ -96,8 +110,11 @@ void StudyView::setupUi() {
         {tr("简单 (Easy)"), "#3B82F6", &StudyView::onRateEasy}
     };
 
-    for (const auto& b : btns) {
+    for (int i = 0; i < 4; ++i) {
+        const RateBtn& b = btns[i];
         QPushButton *btn = new QPushButton(b.text, this);
+        m_rateButtons[i] = btn;
+        m_rateLabels.append(b.text);
         btn->setMinimumHeight(50);
         btn->setCursor(Qt::PointingHandCursor);
         btn->setStyleSheet(QString("QPushButton { background-color: %1; color: white; font-weight: bold; border: none; border-radius: 8px; } QPushButton:hover { background-color: %1; opacity: 0.9; }").arg(b.color));
@@ -122,27 +139,34 @@ void StudyView::refreshBooks() {
 
 void StudyView::startSession() {
     int bookId = m_comboBook->currentData().toInt();
+    m_scheduler = FsrsScheduler();
+    m_scheduler.setDayLoad([](const QDate& date) {
+        return DatabaseManager::instance().dueIndex().dueOn(date);
+    });
+    m_prefetcher->cancel();
+    m_cards.clear();
+    m_waitingForBatch = false;
+    m_learning = {};
+    m_learningTimer->stop();
+
+    m_bookId = bookId;
+    m_mode = m_comboOrder->currentIndex() == 1 ? StudyPrefetcher::Mode::AtRisk : StudyPrefetcher::Mode::Due;
+    QSettings settings("AutoWord", "Config");
+    m_newOrder = settings.value("Study/NewWordOrder", 0).toInt() == 1
+        ? NewWordOrder::Sequential : NewWordOrder::Random;
+
+    if (m_mode == StudyPrefetcher::Mode::AtRisk) {
+        m_sessionQueue = DatabaseManager::instance().getAtRiskWords(bookId, SESSION_BATCH);
+    } else {
+        m_sessionQueue = DatabaseManager::instance().getDueWords(bookId, SESSION_BATCH);
+    }
     
 
-    m_sessionQueue = DatabaseManager::instance().getDueWords(bookId, 20);
-    
-
-    if (m_sessionQueue.size() < 20) {
-        QList<Word> allWords = DatabaseManager::instance().getAllWords(bookId);
-
-        auto rng = std::default_random_engine(std::chrono::system_clock::now().time_since_epoch().count());
-        std::shuffle(allWords.begin(), allWords.end(), rng);
-        
-        for (const Word& w : allWords) {
-            if (m_sessionQueue.size() >= 20) break;
-            
-
-            bool exists = false;
-            for (const Word& existing : m_sessionQueue) {
-                if (existing.id == w.id) { exists = true; break; }
-            }
-            if (!exists) m_sessionQueue.append(w);
-        }
+    if (m_sessionQueue.size() < SESSION_BATCH) {
+        QSet<int> queued;
+        for (const Word& w : m_sessionQueue) queued.insert(w.id);
+        m_sessionQueue += DatabaseManager::instance().getNewWords(bookId, SESSION_BATCH - int(m_sessionQueue.size()),
+                                                                  m_newOrder, queued);
     } 
     m_currentIndex = 0;
     
@@ -150,19 +174,112 @@ void StudyView::startSession() {
         QMessageBox::information(this, tr("提示"), tr("当前词书没有单词。"));
         return;
     }
+    prefetchSpeech(m_sessionQueue);
     
     showNextCard();
 }
 
 void StudyView::showNextCard() {
+    if (m_currentIndex >= m_sessionQueue.size() && m_prefetcher->hasBatch()) {
+        // An empty batch only means nothing new is due; learning steps may
+        // still be waiting below.
+        appendBatch();
+    }
+    if (m_currentIndex >= m_sessionQueue.size() && !m_learning.empty() && !m_prefetcher->isPending()) {
+        // Nothing else left to study; take the next learning step early.
+        m_sessionQueue.append(m_learning.top().word);
+        m_learning.pop();
+        armLearningTimer();
+    }
     if (m_currentIndex >= m_sessionQueue.size()) {
-        QMessageBox::information(this, tr("完成"), tr("今日学习任务已完成！"));
+        if (!m_prefetcher->isPending()) {
+            showFinished();
+            return;
+        }
+        // Only reached if the user outpaces the prefetch; onBatchReady resumes.
+        m_waitingForBatch = true;
+        m_lblWord->setText(tr("加载中..."));
+        m_lblPhonetic->clear();
+        m_answerContainer->hide();
+        m_ratingWidget->hide();
+        m_btnShowAnswer->hide();
         return;
     }
-    
+
+    prefetchIfNeeded();
     showQuestion();
 }
 
+void StudyView::prefetchIfNeeded() {
+    if (m_sessionQueue.size() - m_currentIndex > PREFETCH_AHEAD) return;
+
+    QSet<int> queued;
+    for (const Word& w : m_sessionQueue) queued.insert(w.id);
+    m_prefetcher->request(m_bookId, SESSION_BATCH, m_mode, m_newOrder, queued);
+}
+
+bool StudyView::appendBatch() {
+    QList<Word> words = m_prefetcher->takeWords();
+    QHash<int, FsrsCard> cards = m_prefetcher->takeCards();
+    if (words.isEmpty()) return false;
+
+    m_sessionQueue += words;
+    m_cards.insert(cards);
+    prefetchSpeech(words);
+    return true;
+}
+
+void StudyView::prefetchSpeech(const QList<Word>& words) {
+    QStringList spellings;
+    for (const Word& w : words) spellings.append(w.spelling);
+    TtsEngine::instance().prefetch(spellings);
+}
+
+void StudyView::showFinished() {
+    // Only reached with the queue, the learning steps and the prefetcher all
+    // empty; nothing may pop up behind the dialog.
+    m_learningTimer->stop();
+    m_waitingForBatch = false;
+    QMessageBox::information(this, tr("完成"), tr("今日学习任务已完成！"));
+}
+
+void StudyView::scheduleLearningStep(const Word& word, const QDateTime& due) {
+    m_learning.push({due.toMSecsSinceEpoch(), word});
+    armLearningTimer();
+}
+
+void StudyView::armLearningTimer() {
+    if (m_learning.empty()) {
+        m_learningTimer->stop();
+        return;
+    }
+    const qint64 wait = m_learning.top().due - QDateTime::currentMSecsSinceEpoch();
+    m_learningTimer->start(int(std::clamp<qint64>(wait, 0, 24 * 3600 * 1000)));
+}
+
+void StudyView::onLearningStepDue() {
+    const bool idle = m_currentIndex >= m_sessionQueue.size();
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    // Due steps go right after the current card, earliest first.
+    int insertAt = std::min<int>(m_currentIndex + 1, int(m_sessionQueue.size()));
+    while (!m_learning.empty() && m_learning.top().due <= now) {
+        m_sessionQueue.insert(insertAt++, m_learning.top().word);
+        m_learning.pop();
+    }
+    armLearningTimer();
+
+    if (idle && m_currentIndex < m_sessionQueue.size()) {
+        m_waitingForBatch = false;
+        showNextCard();
+    }
+}
+
+void StudyView::onBatchReady() {
+    if (!m_waitingForBatch) return;
+    m_waitingForBatch = false;
+    showNextCard();
+}
+
 void StudyView::showQuestion() {
     const Word &word = m_sessionQueue[m_currentIndex];
     m_lblWord->setText(word.spelling);
@@ -172,6 +289,7 @@ void StudyView::showQuestion() {
     
     m_answerContainer->hide();
     m_ratingWidget->hide();
+    m_hasPreview = false;
     m_btnShowAnswer->show();
     
     TtsEngine::instance().speak(word.spelling);
@@ -181,6 +299,7 @@ void StudyView::showQuestion() {
 }
 
 void StudyView::showAnswer() {
+    preparePreview();
     m_btnShowAnswer->hide();
     m_answerContainer->show();
     m_ratingWidget->show();
@@ -205,20 +324,65 @@ void StudyView::onShowAnswer() {
     showAnswer();
 }
 
+void StudyView::preparePreview() {
+    if (m_currentIndex >= m_sessionQueue.size()) return;
+
+    m_previewTime = QDateTime::currentDateTime();
+    const int wordId = m_sessionQueue[m_currentIndex].id;
+    auto cached = m_cards.constFind(wordId);
+    m_currentCard = cached != m_cards.constEnd() ? cached.value() : DatabaseManager::instance().getCard(wordId);
+    if (m_currentCard.lastReview.isValid()) {
+        m_currentCard.elapsedDays = int(m_currentCard.lastReview.daysTo(m_previewTime));
+    }
+    m_preview = m_scheduler.previewAll(m_currentCard, m_previewTime);
+    m_hasPreview = true;
+
+    for (int i = 0; i < 4; ++i) {
+        const FsrsCard& outcome = m_preview.outcomes[i];
+        m_rateButtons[i]->setText(QString("%1\n%2").arg(m_rateLabels[i],
+            formatInterval(m_previewTime, outcome.due.isValid() ? outcome.due : m_previewTime)));
+    }
+}
+
+QString StudyView::formatInterval(const QDateTime& now, const QDateTime& due) {
+    qint64 secs = std::max<qint64>(60, now.secsTo(due));
+    if (secs < 3600) return tr("%1分钟").arg(secs / 60);
+    if (secs < 86400) return tr("%1小时").arg(secs / 3600);
+    qint64 days = now.daysTo(due);
+    if (days < 30) return tr("%1天").arg(days);
+    if (days < 365) return tr("%1个月").arg(days / 30.0, 0, 'f', 1);
+    return tr("%1年").arg(days / 365.0, 0, 'f', 1);
+}
+
 void StudyView::processRating(int rating) {
     if (m_currentIndex >= m_sessionQueue.size()) return;
     
     const Word &word = m_sessionQueue[m_currentIndex];
-    
-
-    FsrsCard card = DatabaseManager::instance().getCard(word.id);
-    
+    if (!m_hasPreview) preparePreview();
 
-    FsrsRating::Rating fsrsRating = static_cast<FsrsRating::Rating>(rating);
-    FsrsCard nextCard = m_scheduler.schedule(card, fsrsRating);
+    // The outcome was computed when the answer was shown; commit it as is.
+    const FsrsCard& card = m_currentCard;
+    FsrsCard nextCard = m_preview[static_cast<FsrsRating::Rating>(rating)];
+    m_hasPreview = false;
     
 
     DatabaseManager::instance().updateCard(nextCard);
+    if (nextCard.scheduledDays == 0 && nextCard.due > m_previewTime) {
+        // Keep the card in memory; the next step needs no database read.
+        m_cards.insert(word.id, nextCard);
+        scheduleLearningStep(word, nextCard.due);
+    } else {
+        m_cards.remove(word.id);
+    }
+
+    ReviewLog log;
+    log.wordId = word.id;
+    log.rating = rating;
+    log.state = card.state;
+    log.elapsedDays = card.elapsedDays;
+    log.scheduledDays = nextCard.scheduledDays;
+    log.reviewedAt = m_previewTime;
+    DatabaseManager::instance().addReviewLog(log);
     
 
     m_currentIndex++;
@@ -6,7 +6,12 @@
 #include <QHBoxLayout>
 #include <QStackedWidget>
 #include <QComboBox>
+#include <QTimer>
+#include <functional>
+#include <queue>
+#include <vector>
 #include "../core/FsrsScheduler.h"
+#include "../core/StudyPrefetcher.h"
 #include "../core/Word.h"
 #include "../core/Book.h"
 #include "ThemeManager.h"
@@ -29,13 +34,23 @@ private slots:
     void onRateHard();
     void onRateGood();
     void onRateEasy();
+    void onBatchReady();
+    void onLearningStepDue();
 
 private:
     void setupUi();
     void showNextCard();
+    void prefetchIfNeeded();
+    bool appendBatch();
+    void prefetchSpeech(const QList<Word>& words);
+    void showFinished();
+    void scheduleLearningStep(const Word& word, const QDateTime& due);
+    void armLearningTimer();
     void showQuestion();
     void showAnswer();
     void processRating(int rating);
+    void preparePreview();
+    static QString formatInterval(const QDateTime& now, const QDateTime& due);
 
     QLabel *m_lblWord;
     QLabel *m_lblPhonetic;
@@ -43,10 +58,36 @@ private:
     QLabel *m_lblExample;
     QPushButton *m_btnShowAnswer;
     QWidget *m_ratingWidget;
+    QPushButton *m_rateButtons[4];
+    QStringList m_rateLabels;
     QWidget *m_answerContainer;
     QComboBox *m_comboBook;
+    QComboBox *m_comboOrder;
     
     QList<Word> m_sessionQueue;
     int m_currentIndex;
     FsrsScheduler m_scheduler;
+
+    // Session settings captured at start, reused for every prefetched batch.
+    int m_bookId = -1;
+    StudyPrefetcher::Mode m_mode = StudyPrefetcher::Mode::Due;
+    NewWordOrder m_newOrder = NewWordOrder::Random;
+    StudyPrefetcher *m_prefetcher;
+    QHash<int, FsrsCard> m_cards;
+    bool m_waitingForBatch = false;
+
+    // Cards in a sub-day learning step, earliest due first. They rejoin the
+    // queue from memory when due, or early once nothing else is left.
+    struct LearningStep {
+        qint64 due;
+        Word word;
+        bool operator>(const LearningStep& other) const { return due > other.due; }
+    };
+    std::priority_queue<LearningStep, std::vector<LearningStep>, std::greater<LearningStep>> m_learning;
+    QTimer *m_learningTimer;
+
+    FsrsCard m_currentCard;
+    FsrsPreview m_preview;
+    QDateTime m_previewTime;
+    bool m_hasPreview = false;
 };
@@ -1,6 +1,7 @@
 #include "TestView.h"
 #include "../db/DatabaseManager.h"
 #include "../core/TtsEngine.h"
+#include "../core/NeighborIndexer.h"
 #include "ThemeManager.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
@@ -16,6 +17,7 @@
 #include <QGraphicsOpacityEffect>
 #include <QKeyEvent>
 #include <QApplication>
+#include <QDebug>
 #ifdef Q_OS_WIN
 #include <windows.h>
 #endif
@@ -143,29 +145,44 @@ void TestView::setupUi() {
 }
 
 void TestView::startTest() {
+    // Answers from a test left midway still count.
+    applyTestResults();
+
     int bookId = m_comboBook->currentData().toInt();
-    m_testQueue = DatabaseManager::instance().getAllWords(bookId);
+    m_testQueue = DatabaseManager::instance().getTestWords(bookId, m_spinCount->value());
     
     if (m_testQueue.isEmpty()) {
         QMessageBox::warning(this, tr("开始测试"), tr("当前词书没有单词，无法开始测试。"));
         return;
     }
-    
-    auto rng = std::default_random_engine(std::chrono::system_clock::now().time_since_epoch().count());
-    std::shuffle(m_testQueue.begin(), m_testQueue.end(), rng);
-    
-    int count = m_spinCount->value();
-    if (m_testQueue.size() > count) {
-        m_testQueue = m_testQueue.mid(0, count);
+
+    m_distractors.clear();
+    m_neighbors.clear();
+    if (m_currentMode == Recalling) {
+        m_distractors.load(DatabaseManager::instance().database(), bookId);
+        // Confusable neighbors are used once built; until then distractors
+        // are random and the lists are built in the background.
+        m_neighbors = DatabaseManager::instance().getWordNeighbors(bookId);
+        if (!DatabaseManager::instance().hasFreshWordNeighbors(bookId)) {
+            NeighborIndexer::startInBackground(bookId);
+        }
+    }
+
+    if (m_currentMode == Recalling) {
+        QStringList spellings;
+        for (const Word& w : m_testQueue) spellings.append(w.spelling);
+        TtsEngine::instance().prefetch(spellings);
     }
 
     m_currentIndex = 0;
     m_correctCount = 0;
+    m_answers.clear();
     showQuestion();
 }
 
 void TestView::showQuestion() {
     if (m_currentIndex >= m_testQueue.size()) {
+        applyTestResults();
         m_lblQuestion->setText(tr("测试结束！"));
         m_lblQuestionType->setText("");
         m_answerStack->hide();
@@ -220,33 +237,98 @@ void TestView::showQuestion() {
 }
 
 void TestView::generateDistractors(const Word& correctWord, QList<Word>& distractors) {
-    QList<Word> allWords = DatabaseManager::instance().getAllWords(m_comboBook->currentData().toInt());
-    
-    for (int i = 0; i < allWords.size(); ++i) {
-        if (allWords[i].id == correctWord.id) {
-            allWords.removeAt(i);
-            break;
-        }
+    QList<int> candidates;
+    for (int id : m_neighbors.value(correctWord.id)) {
+        int index = m_distractors.indexOf(id);
+        if (index >= 0) candidates.append(index);
     }
 
-    if (allWords.size() < 3) {
-        distractors = allWords;
-        while(distractors.size() < 3) {
-            Word w;
-            w.id = -1;
-            w.spelling = "N/A";
-            w.definition = "选项不足";
-            distractors.append(w);
+    // Up to three of the confusable neighbors, topped up at random.
+    QList<int> picked;
+    while (picked.size() < 3 && !candidates.isEmpty()) {
+        picked.append(candidates.takeAt(QRandomGenerator::global()->bounded(int(candidates.size()))));
+    }
+    QList<int> excluded = {correctWord.id};
+    for (int index : picked) excluded.append(m_distractors.idAt(index));
+    picked += m_distractors.sample(3 - int(picked.size()), excluded);
+
+    distractors.clear();
+    for (int index : picked) {
+        Word w;
+        w.id = m_distractors.idAt(index);
+        w.definition = m_distractors.definitionAt(index);
+        distractors.append(w);
+    }
+
+    while (distractors.size() < 3) {
+        Word w;
+        w.id = -1;
+        w.spelling = "N/A";
+        w.definition = "选项不足";
+        distractors.append(w);
+    }
+}
+
+void TestView::recordAnswer(const Word& word, bool correct) {
+    // The answer box still accepts Enter after a check; count each question once.
+    if (m_answers.size() > m_currentIndex) return;
+
+    ReviewLog log;
+    log.wordId = word.id;
+    log.rating = correct ? FsrsRating::Good : FsrsRating::Again;
+    log.kind = ReviewKind::Test;
+    log.reviewedAt = QDateTime::currentDateTime();
+    m_answers.append(log);
+}
+
+void TestView::applyTestResults() {
+    if (m_answers.isEmpty()) return;
+
+    QList<int> ids;
+    for (const ReviewLog& log : m_answers) ids.append(log.wordId);
+    QHash<int, FsrsCard> cards;
+    for (const FsrsCard& card : DatabaseManager::instance().getCards(ids)) cards.insert(card.wordId, card);
+
+    // Only words already in review are rescheduled; a test does not
+    // introduce new words. The review transition ignores elapsed time, so a
+    // card that is not due yet is left alone and the answer only logged;
+    // rescheduling it would multiply its stability for a recent success.
+    FsrsScheduler scheduler;
+    scheduler.setDayLoad([](const QDate& date) {
+        return DatabaseManager::instance().dueIndex().dueOn(date);
+    });
+    QList<FsrsCard> updated;
+    QList<ReviewLog> logs;
+    for (ReviewLog log : m_answers) {
+        auto it = cards.find(log.wordId);
+        if (it == cards.end() || it.value().state == 0) continue;
+
+        FsrsCard card = it.value();
+        card.elapsedDays = card.lastReview.isValid() ? int(card.lastReview.daysTo(log.reviewedAt)) : 0;
+        log.state = card.state;
+        log.elapsedDays = card.elapsedDays;
+        if (card.due.isValid() && card.due > log.reviewedAt) {
+            log.kind = ReviewKind::Check;
+            log.scheduledDays = card.scheduledDays;
+            logs.append(log);
+            continue;
         }
-    } else {
-        auto rng = std::default_random_engine(std::chrono::system_clock::now().time_since_epoch().count());
-        std::shuffle(allWords.begin(), allWords.end(), rng);
-        distractors = allWords.mid(0, 3);
+        FsrsCard next = scheduler.schedule(card, static_cast<FsrsRating::Rating>(log.rating), log.reviewedAt);
+        log.scheduledDays = next.scheduledDays;
+        it.value() = next;
+        updated.append(next);
+        logs.append(log);
+    }
+    m_answers.clear();
+
+    if (!DatabaseManager::instance().applyReviews(updated, logs)) {
+        qWarning() << "Failed to apply test results";
     }
 }
 
 void TestView::onChoiceClicked(int index) {
     bool isCorrect = (index == m_correctOptionIndex);
+    recordAnswer(m_testQueue[m_currentIndex], isCorrect);
     
     for (int i = 0; i < 4; ++i) {
         m_choiceButtons[i]->setEnabled(false);
@@ -309,6 +391,7 @@ void TestView::onCheckAnswer() {
     if (userAnswer.compare(word.spelling, Qt::CaseInsensitive) == 0) {
         correct = true;
     }
+    recordAnswer(word, correct);
 
     if (correct) {
         m_lblResult->setText(tr("回答正确！"));
@@ -9,6 +9,8 @@
 #include <QComboBox>
 #include <QButtonGroup>
 #include "../core/WordModel.h"
+#include "../core/FsrsScheduler.h"
+#include "../core/DistractorPool.h"
 
 class TestView : public QWidget {
     Q_OBJECT
@@ -32,9 +34,15 @@ private:
     void updateTheme(int theme); 
     void refreshBooks();
     void generateDistractors(const Word& correctWord, QList<Word>& distractors);
+    void recordAnswer(const Word& word, bool correct);
+    void applyTestResults();
 
     WordModel *m_model;
     QList<Word> m_testQueue;
+    DistractorPool m_distractors;
+    QHash<int, QList<int>> m_neighbors;
+    // One entry per answered question; applied to the cards when the test ends.
+    QList<ReviewLog> m_answers;
     int m_currentIndex;
     int m_correctCount;
     int m_correctOptionIndex; 